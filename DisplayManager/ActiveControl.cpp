@@ -0,0 +1,107 @@
+#include "ActiveControl.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+class ActiveControl::Data {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // a panel holding more than this is drained over several steps
+  static const int drain = 8;
+
+  milliseconds interval{ 0 };
+  std::unordered_map<std::string, bool> advertised;
+  std::unordered_map<std::string, Clock::time_point> polled;
+
+  bool supported(const DisplayObject& device) const {
+    const auto iter = advertised.find(device.serial());
+    return iter == advertised.end() || iter->second;
+  }
+
+  void poll(const DisplayObject& device, DisplayHealth& health, const Changed& changed) {
+    TRACE_DISPLAY_SCOPE("activeControl", device.traceTrack());
+    bool probing = advertised.find(device.serial()) == advertised.end();
+    try {
+      uint8_t seen[drain];
+      int count = 0;
+      while (count < drain) {
+        uint32_t code, max;
+        if (!device.readRange(VcpCode::active_control, code, max)) {
+          // a panel that doesn't answer the probe doesn't have the control, one that has it
+          // and doesn't answer is failing
+          if (probing)
+            advertised[device.serial()] = false;
+          else
+            health.failed(device);
+          return;
+        }
+        health.succeeded(device);
+        probing = false;
+        advertised[device.serial()] = true;
+
+        code &= 0xFF;
+        if (code == 0 || code == uint8_t(VcpCode::active_control))
+          return;
+        // a control changed twice is in the queue twice, reading it once is enough
+        if (std::find(seen, seen + count, uint8_t(code)) != seen + count)
+          continue;
+        seen[count++] = uint8_t(code);
+
+        uint32_t current;
+        if (device.readRange(VcpCode(code), current, max))
+          changed(device, VcpCode(code), current, max);
+      }
+    }
+    catch (std::exception& e) {
+      LOG_WARNING("Active control poll failed on {} {}", device.serial(), e.what());
+      health.failed(device);
+    }
+  }
+};
+
+ActiveControl::~ActiveControl() {}
+
+ActiveControl::ActiveControl()
+: data(std::make_unique<Data>())
+{}
+
+void ActiveControl::configure(milliseconds interval) {
+  d().interval = interval;
+}
+
+void ActiveControl::reset(std::unordered_map<std::string, bool> advertised) {
+  d().advertised = std::move(advertised);
+  d().polled.clear();
+}
+
+ActiveControl::milliseconds ActiveControl::step(const devices& displays, DisplayHealth& health, const Changed& changed) {
+  if (d().interval <= milliseconds::zero())
+    return milliseconds::max();
+
+  // displays never polled count as due right away, oldest poll first
+  const auto now = Data::Clock::now();
+  const DisplayObject* next = nullptr;
+  auto next_due = Data::Clock::time_point::max();
+  for (auto& device : displays) {
+    if (!d().supported(device) || health.quarantined(device))
+      continue;
+    const auto iter = d().polled.find(device.serial());
+    const auto due = iter == d().polled.end() ? Data::Clock::time_point::min() : iter->second + d().interval;
+    if (!next || due < next_due) {
+      next = &device;
+      next_due = due;
+    }
+  }
+  if (!next)
+    return milliseconds::max();
+
+  // one display per step, so a poll never holds the worker for long
+  if (next_due <= now) {
+    d().polled[next->serial()] = now;
+    d().poll(*next, health, changed);
+    return milliseconds(0);
+  }
+  return std::chrono::duration_cast<milliseconds>(next_due - now) + milliseconds(1);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+#include "DisplayHealth.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// Notices changes made on the monitors themselves, like an input picked with the panel's own
+// buttons. Panels listing VCP 0x52 (active control) queue the code of every control changed
+// that way, and each read of 0x52 takes one off the queue, 0 once it is empty. So a display
+// costs one read per interval, and only the controls that actually changed are read back.
+// Quarantined displays aren't polled, and a display known to have the control that stops
+// answering counts against its health. Only called from the device worker thread.
+class ActiveControl : NONCOPY {
+  PIMPL
+
+public:
+  using milliseconds = std::chrono::milliseconds;
+  using Changed = std::function<void(const DisplayObject&, VcpCode code, uint32_t current, uint32_t max)>;
+
+  ~ActiveControl();
+  ActiveControl();
+
+  // how often each display is asked, 0 disables polling
+  void configure(milliseconds interval);
+  // the displays were re-enumerated. serial -> whether its capabilities list 0x52, displays
+  // missing here get a single read of 0x52 to find out
+  void reset(std::unordered_map<std::string, bool> advertised);
+
+  // polls the display that is due and reports every control it says was changed,
+  // returns how long until the next one is
+  milliseconds step(const devices& displays, DisplayHealth& health, const Changed& changed);
+};
@@ -0,0 +1,61 @@
+#include "AllocationCount.h"
+
+#ifdef DM_ALLOC_COUNT
+#include <cstdlib>
+#include <new>
+
+namespace {
+  thread_local uint64_t allocations = 0;
+
+  void* allocate(std::size_t size) {
+    ++allocations;
+    if (size == 0)
+      size = 1;
+    while (true) {
+      if (void* result = std::malloc(size))
+        return result;
+      const auto handler = std::get_new_handler();
+      if (!handler)
+        throw std::bad_alloc();
+      handler();
+    }
+  }
+
+  void* allocate(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+      return allocate(size);
+    }
+    catch (std::bad_alloc&) {
+      return nullptr;
+    }
+  }
+}
+
+bool AllocationCount::enabled() {
+  return true;
+}
+
+uint64_t AllocationCount::thisThread() {
+  return allocations;
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, tag); }
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return allocate(size, tag); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#else
+bool AllocationCount::enabled() {
+  return false;
+}
+
+uint64_t AllocationCount::thisThread() {
+  return 0;
+}
+#endif
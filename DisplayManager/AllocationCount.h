@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocations made through operator new, counted per thread by replacing the global
+// allocation functions. Only builds defining DM_ALLOC_COUNT (the Bench configuration) replace
+// them, every other build keeps the standard ones and counts nothing. Qt's own containers
+// allocate with malloc inside Qt and aren't seen.
+class AllocationCount {
+public:
+  // false if this build doesn't count
+  static bool enabled();
+  // allocations made so far by the calling thread, always 0 if not enabled
+  static uint64_t thisThread();
+};
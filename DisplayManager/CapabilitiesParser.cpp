@@ -1,5 +1,6 @@
 #include "CapabilitiesParser.h"
 #include <functional>
+#include <stdexcept>
 
 void feature::add(const std::string& s, feature* f) {
   members.emplace(s, f);
@@ -77,4 +78,89 @@ feature* parseFeatures(const std::string& source) {
   };
   feature* top = recurse();
   return top;
-}
\ No newline at end of file
+}
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     CapabilitiesStream
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+CapabilitiesStream::CapabilitiesStream(const std::vector<std::string>& codes)
+: remaining(0)
+{
+  for (auto& code : codes) {
+    if (watched.emplace(code, std::vector<std::string>()).second)
+      ++remaining;
+  }
+}
+
+// a finished word, listed as a value if it sits directly inside a watched code
+void CapabilitiesStream::token(std::string& text) {
+  if (text.empty())
+    return;
+  // a watched code without values, e.g. "52", is complete as soon as it is seen
+  if (!path.empty() && path.back() == "vcp") {
+    if (watched.count(text) && seen.insert(text).second)
+      --remaining;
+  }
+  else if (path.size() >= 2 && path[path.size() - 2] == "vcp") {
+    const auto iter = watched.find(path.back());
+    if (iter != watched.end())
+      iter->second.push_back(text);
+  }
+  text.clear();
+}
+
+void CapabilitiesStream::feed(const std::string& fragment) {
+  for (char c : fragment) {
+    if (done())
+      return;
+
+    if (c == '(') {
+      // "60(" and "60 (" both name the section that follows
+      path.push_back(current.empty() ? last : current);
+      current.clear();
+      last.clear();
+    }
+    else if (c == ')') {
+      token(last);
+      token(current);
+      if (path.empty())
+        continue;
+
+      const auto closed = path.back();
+      path.pop_back();
+      if (path.empty())
+        ended = true;
+      else if (path.back() == "vcp" && watched.count(closed) && seen.insert(closed).second)
+        --remaining;
+      // codes missing from the vcp list won't show up later
+      else if (closed == "vcp")
+        ended = true;
+    }
+    else if (c == ' ' || c == '\0') {
+      if (!current.empty()) {
+        token(last);
+        last.swap(current);
+      }
+    }
+    else {
+      token(last);
+      current += c;
+    }
+  }
+}
+
+bool CapabilitiesStream::done() const {
+  return ended || remaining <= 0;
+}
+
+const std::vector<std::string>& CapabilitiesStream::values(const std::string& code) const {
+  static const std::vector<std::string> none;
+  const auto iter = watched.find(code);
+  return iter != watched.end() ? iter->second : none;
+}
+
+bool CapabilitiesStream::listed(const std::string& code) const {
+  return seen.count(code) > 0;
+}
@@ -1,5 +1,7 @@
 #pragma once
+#include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 class feature {
@@ -13,4 +15,32 @@ public:
   std::vector<std::string> keys();
 };
 
-feature* parseFeatures(const std::string& source);
\ No newline at end of file
+feature* parseFeatures(const std::string& source);
+
+// parses a capabilities string fragment by fragment as it comes off the bus, collecting the
+// values of a few vcp codes, so reading can stop as soon as those codes have been seen
+class CapabilitiesStream {
+public:
+  // hex codes as they appear in the string, e.g. "60" for the input sources
+  explicit CapabilitiesStream(const std::vector<std::string>& codes);
+
+  void feed(const std::string& fragment);
+
+  // every watched code was read in full, or can't appear anymore
+  bool done() const;
+  // the values listed for a watched code, empty if it had none
+  const std::vector<std::string>& values(const std::string& code) const;
+  // whether a watched code is in the vcp list at all, with or without values
+  bool listed(const std::string& code) const;
+
+private:
+  void token(std::string& text);
+
+  std::unordered_map<std::string, std::vector<std::string>> watched;
+  std::unordered_set<std::string> seen;
+  std::vector<std::string> path;
+  std::string current;
+  std::string last;
+  int remaining;
+  bool ended = false;
+};
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+
+#include <atomic>
+#include <utility>
+
+// unbounded multi-producer single-consumer queue (Vyukov style)
+// push may be called from any thread, pop only ever from the consuming thread
+template<typename T>
+class CommandQueue : public NONCOPY {
+  struct Node {
+    std::atomic<Node*> next;
+    T value;
+
+    Node() : next(nullptr) {}
+    explicit Node(T&& v) : next(nullptr), value(std::move(v)) {}
+  };
+
+  std::atomic<Node*> head;
+  Node* tail;
+
+public:
+  CommandQueue()
+  : head(new Node())
+  , tail(head.load(std::memory_order_relaxed))
+  {}
+  ~CommandQueue() {
+    T discard;
+    while (pop(discard));
+    delete tail;
+  }
+
+  void push(T value) {
+    Node* node = new Node(std::move(value));
+    Node* prev = head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
+
+  // returns false if empty, or if a producer is halfway through a push
+  bool pop(T& result) {
+    Node* const front = tail;
+    Node* const next = front->next.load(std::memory_order_acquire);
+    if (!next)
+      return false;
+
+    result = std::move(next->value);
+    tail = next;
+    delete front;
+    return true;
+  }
+};
@@ -0,0 +1,345 @@
+#include "ControlServer.h"
+#include "DeskSnapshot.h"
+#include "DeviceWorker.h"
+#include "HubWatch.h"
+#include "PeerLink.h"
+#include "SharedState.h"
+
+#include <deque>
+#include <iostream>
+#include <unordered_map>
+
+#include <QDebug>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QPointer>
+#include <QSettings>
+
+const char * ControlServer::socket_name = "DisplayManager";
+
+class ControlServer::Data {
+  // worker completions, or commandFailed in their place, arrive in the order commands were
+  // posted, so a fifo of outstanding replies is enough to route each one back to its client
+  struct Pending {
+    QPointer<QLocalSocket> socket;
+    QByteArray reply;
+  };
+
+public:
+  ControlServer& owner;
+
+  DeviceWorker * const worker;
+  DeskSnapshot * const desk;
+  HubWatch * const watch;
+  PeerLink * const peer;
+  QLocalServer * const server;
+
+  DisplayInfoList displays;
+  std::unordered_map<std::string, VcpValue> inputs;
+  bool profile_toggle = false;
+
+  SharedStatePublisher state;
+  SharedSnapshot snapshot;
+
+  std::deque<Pending> pending;
+  QPointer<QLocalSocket> watch_client;
+
+  Data(ControlServer& _owner)
+  : owner(_owner)
+  , worker(new DeviceWorker(&_owner))
+  , desk(new DeskSnapshot(*worker, &_owner))
+  , watch(new HubWatch(*worker, &_owner))
+  , peer(new PeerLink(*worker, &_owner))
+  , server(new QLocalServer(&_owner))
+  {}
+
+  static void reply(QLocalSocket* socket, const QByteArray& line) {
+    if (!socket)
+      return;
+    socket->write(line);
+    socket->write("\n");
+    socket->flush();
+  }
+
+  void expect(QLocalSocket* socket, const QByteArray& line) {
+    pending.push_back(Pending{ socket, line });
+  }
+
+  void complete() {
+    if (pending.empty())
+      return;
+    reply(pending.front().socket, pending.front().reply);
+    pending.pop_front();
+  }
+
+  // the command at the front threw, it won't complete any other way
+  void abandon(const QString& reason) {
+    if (pending.empty())
+      return;
+    reply(pending.front().socket, "err " + reason.toUtf8());
+    pending.pop_front();
+  }
+
+  static void report(QLocalSocket* socket, const SwitchResultList& results) {
+    static const char * outcomes[] = { "confirmed", "unconfirmed", "unreachable", "quarantined" };
+    for (auto& result : results) {
+      reply(socket, QByteArray("display ") + result.serial.c_str() + " " + outcomes[result.outcome] + " "
+        + (result.input.valid() ? result.input.toString().c_str() : "??") + " " + QByteArray::number(result.seconds, 'f', 3));
+    }
+  }
+
+  void publish() {
+    snapshot.displays.clear();
+    for (auto& display : displays) {
+      const auto iter = inputs.find(display.serial);
+      snapshot.displays.push_back(SharedDisplay{ display.serial, display.name.toStdString(), iter != inputs.end() ? iter->second : VcpValue(), display.sources });
+    }
+    state.publish(snapshot);
+  }
+
+  void setInput(const std::string& serial, VcpValue input) {
+    auto& known = inputs[serial];
+    if (known == input)
+      return;
+    known = input;
+    publish();
+  }
+
+  void load(QLocalSocket* socket, const QString& name) {
+    worker->loadProfile(name);
+    expect(socket, "ok switch " + name.toUtf8());
+  }
+
+  void handleRefreshed(const DisplayInfoList& result) {
+    displays = result;
+    // known inputs stay until the reads below confirm or replace them
+    std::unordered_map<std::string, VcpValue> kept;
+    for (auto& display : displays) {
+      const auto iter = inputs.find(display.serial);
+      if (iter != inputs.end())
+        kept.insert(*iter);
+    }
+    inputs.swap(kept);
+    for (auto& display : displays)
+      worker->readCurrent(display.serial);
+    publish();
+    complete();
+  }
+
+  void handleLine(QLocalSocket* socket, const QString& line) {
+    const int split = line.indexOf(' ');
+    const QString verb = split < 0 ? line : line.left(split);
+    const QString arg = split < 0 ? QString() : line.mid(split + 1).trimmed();
+
+    if (verb == "switch" && !arg.isEmpty()) {
+      load(socket, arg);
+    }
+    else if (verb == "toggle") {
+      load(socket, profile_toggle ? QString("profile a") : QString("profile b"));
+      profile_toggle = !profile_toggle;
+    }
+    else if (verb == "save" && !arg.isEmpty()) {
+      worker->saveProfile(arg);
+      expect(socket, "ok save " + arg.toUtf8());
+    }
+    else if (verb == "query") {
+      for (auto& display : displays) {
+        const auto iter = inputs.find(display.serial);
+        const std::string input = iter != inputs.end() && iter->second.valid() ? iter->second.toString() : "??";
+        reply(socket, QByteArray("display ") + display.serial.c_str() + " " + input.c_str() + " " + display.name.toUtf8());
+      }
+      reply(socket, "ok query " + QByteArray::number((int)displays.size()));
+    }
+    else if (verb == "watch" && arg == "on") {
+      // started and refused answer one client, the first one waiting keeps the answer
+      if (watch_client) {
+        reply(socket, "err watch on already in progress");
+        return;
+      }
+      QSettings settings;
+      watch->setHub(settings.value("Hub").toString().toStdWString());
+      watch_client = socket;
+      watch->start();
+    }
+    else if (verb == "watch" && arg == "off") {
+      watch->stop();
+      reply(socket, "ok watch off");
+    }
+    else if ((verb == "brightness" || verb == "contrast") && !arg.isEmpty()) {
+      const auto values = arg.split(' ', QString::SkipEmptyParts);
+      bool valid = true;
+      const int level = values[0].toInt(&valid);
+      const int ramp = values.size() > 1 ? values[1].toInt() : 0;
+      if (!valid || level < 0 || level > 100) {
+        reply(socket, "err level must be 0-100");
+        return;
+      }
+      worker->setLevel(verb == "brightness" ? VcpCode::brightness : VcpCode::contrast, level / 100.0, ramp);
+      (verb == "brightness" ? snapshot.brightness : snapshot.contrast) = level;
+      publish();
+      reply(socket, "ok " + verb.toUtf8() + " " + QByteArray::number(level));
+    }
+    else if (verb == "refresh") {
+      worker->refresh();
+      expect(socket, "ok refresh");
+    }
+    else {
+      reply(socket, "err unknown command: " + line.toUtf8());
+    }
+  }
+
+  // only once listening, so a daemon that doesn't start leaves the displays and the shared
+  // state to the one that is running
+  void start() {
+    // answer queries from the last session's state until the refresh and reads replace it
+    displays = desk->displays();
+    inputs = desk->inputs();
+    profile_toggle = desk->toggled();
+    snapshot.profile = desk->profile().toStdString();
+
+    state.open();
+    publish();
+    worker->refresh();
+    expect(nullptr, QByteArray());
+    peer->configure();
+
+    QSettings settings;
+    const auto hub = settings.value("Hub");
+    if (!hub.isNull()) {
+      watch->setHub(hub.toString().toStdWString());
+      watch->start();
+    }
+  }
+
+  void handleConnection() {
+    while (QLocalSocket* socket = server->nextPendingConnection()) {
+      QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+      QObject::connect(socket, &QLocalSocket::readyRead, &owner, [this, socket]() {
+        while (socket->canReadLine()) {
+          const auto line = QString::fromUtf8(socket->readLine()).trimmed();
+          if (!line.isEmpty())
+            handleLine(socket, line);
+        }
+      });
+    }
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     ControlServer
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+ControlServer::~ControlServer() {}
+
+ControlServer::ControlServer(QObject* parent)
+: QObject(parent)
+, data(std::make_unique<Data>(*this))
+{
+  auto* worker = d().worker;
+  auto* watch = d().watch;
+  auto* peer = d().peer;
+
+  bool valid = true;
+  valid &= (bool)connect(d().server, &QLocalServer::newConnection, this, [this]() { d().handleConnection(); });
+
+  valid &= (bool)connect(worker, &DeviceWorker::refreshed, this, [this](const DisplayInfoList& result) { d().handleRefreshed(result); });
+  valid &= (bool)connect(worker, &DeviceWorker::switchReported, this, [this](const QString&, const SwitchResultList& results) {
+    // ahead of the "ok switch" line that profileLoaded completes with
+    if (!d().pending.empty())
+      d().report(d().pending.front().socket, results);
+  });
+  valid &= (bool)connect(worker, &DeviceWorker::profileLoaded, this, [this](const QString& name) {
+    d().snapshot.profile = name.toStdString();
+    d().publish();
+    d().complete();
+  });
+  valid &= (bool)connect(worker, &DeviceWorker::profileSaved, this, [this]() { d().complete(); });
+  valid &= (bool)connect(worker, &DeviceWorker::commandFailed, this, [this](const QString& reason) { d().abandon(reason); });
+  valid &= (bool)connect(worker, &DeviceWorker::currentRead, this, [this](const std::string& serial, VcpValue input) {
+    d().setInput(serial, input);
+  });
+  valid &= (bool)connect(worker, &DeviceWorker::inputConfirmed, this, [this](const std::string& serial, VcpValue input) {
+    d().setInput(serial, input);
+  });
+
+  valid &= (bool)connect(watch, &HubWatch::started, this, [this]() {
+    Data::reply(d().watch_client, "ok watch on");
+    d().watch_client.clear();
+  });
+  valid &= (bool)connect(watch, &HubWatch::refused, this, [this]() {
+    Data::reply(d().watch_client, "err watched hub is not connected");
+    d().watch_client.clear();
+  });
+  valid &= (bool)connect(watch, &HubWatch::transition, peer, &PeerLink::transition);
+  valid &= (bool)connect(peer, &PeerLink::handoffStarted, worker, &DeviceWorker::prewarm);
+  valid &= (bool)connect(peer, &PeerLink::drive, this, [this](const QString& profile) {
+    d().load(nullptr, profile);
+  });
+  valid &= (bool)connect(peer, &PeerLink::peerDrove, this, [this]() {
+    for (auto& display : d().displays)
+      d().worker->readCurrent(display.serial);
+  });
+  Q_ASSERT(valid);
+}
+
+bool ControlServer::listen() {
+  // a daemon that died without cleaning up leaves its socket file behind, a running one answers
+  {
+    QLocalSocket probe;
+    probe.connectToServer(socket_name);
+    if (probe.waitForConnected(500)) {
+      qWarning() << "A DisplayManager daemon is already running on" << socket_name;
+      return false;
+    }
+  }
+  QLocalServer::removeServer(socket_name);
+  d().server->setSocketOptions(QLocalServer::UserAccessOption);
+  if (!d().server->listen(socket_name)) {
+    qWarning() << "Could not listen on" << socket_name << d().server->errorString();
+    return false;
+  }
+  qDebug() << "Listening on" << d().server->fullServerName();
+
+  d().start();
+  return true;
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     Client
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+int runControlClient(const QStringList& args) {
+  if (args.isEmpty()) {
+    std::cerr << "usage: DisplayManager --ctl <switch|toggle|save|query|watch|brightness|contrast|refresh> [argument]" << std::endl;
+    return 2;
+  }
+
+  QLocalSocket socket;
+  socket.connectToServer(ControlServer::socket_name);
+  if (!socket.waitForConnected(1000)) {
+    std::cerr << "DisplayManager daemon is not running" << std::endl;
+    return 1;
+  }
+
+  socket.write(args.join(' ').toUtf8() + "\n");
+  socket.flush();
+
+  // switches wait on the slowest display, so give the daemon plenty of time
+  const int timeout = 30000;
+  while (true) {
+    if (!socket.canReadLine() && !socket.waitForReadyRead(timeout)) {
+      std::cerr << "no answer from daemon" << std::endl;
+      return 1;
+    }
+    const auto line = socket.readLine().trimmed();
+    std::cout << line.constData() << std::endl;
+    if (line.startsWith("ok"))
+      return 0;
+    if (line.startsWith("err"))
+      return 1;
+  }
+}
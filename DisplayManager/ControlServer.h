@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.h"
+
+#include <QObject>
+#include <QStringList>
+
+// Headless front end: owns the device worker and the hub watch with no widgets, and takes
+// line commands over a local socket (a unix domain socket on linux, a named pipe on windows).
+//
+//   switch <profile>   load a profile, answered once every display reports the new input
+//   toggle             alternate between "profile a" and "profile b"
+//   save <profile>     store the current inputs of every display
+//   query              list "display <serial> <input> <name>" from cached state
+//   watch on|off       start or stop usb triggered switching
+//   brightness <0-100> [ramp ms]
+//   contrast <0-100> [ramp ms]
+//                      match the level across every display, optionally ramping to it
+//   refresh            re-enumerate displays
+//
+// every request is answered with zero or more data lines and a final "ok ..." or "err ..." line.
+// the same state is also published to shared memory, see SharedState.h
+class ControlServer : public QObject {
+  Q_OBJECT
+  PIMPL
+
+public:
+  static const char * socket_name;
+
+  ~ControlServer();
+  ControlServer(QObject* parent = Q_NULLPTR);
+
+  // refuses when another daemon answers on the socket, otherwise starts serving and drives
+  // the displays
+  bool listen();
+};
+
+// sends one command to a running daemon and prints the answer, returns a process exit code
+int runControlClient(const QStringList& args);
@@ -0,0 +1,142 @@
+#include "DdcEngine.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <thread>
+
+DdcEngine::DdcEngine(Listener& _listener)
+: listener(_listener)
+{}
+
+void DdcEngine::setOperationTimeout(Clock::duration value) {
+  timeout = value;
+}
+
+void DdcEngine::reset() {
+  buses.clear();
+}
+
+void DdcEngine::read(const DisplayObject& display, VcpCode code, void* context) {
+  queue(Transaction{ &display, false, code, 0, context, Clock::time_point::max() });
+}
+
+void DdcEngine::write(const DisplayObject& display, VcpCode code, uint32_t value, void* context) {
+  queue(Transaction{ &display, true, code, value, context, Clock::time_point::max() });
+}
+
+void DdcEngine::queue(Transaction transaction) {
+  const int bus = transaction.display->location().bus;
+  if (timeout > Clock::duration::zero())
+    transaction.expires = Clock::now() + timeout;
+  const auto key = bus >= 0 ? std::make_pair(bus, (const DisplayObject*)nullptr) : std::make_pair(-1, transaction.display);
+  buses[key].queue.push_back(transaction);
+}
+
+DdcEngine::Transaction DdcEngine::pop(Bus& bus) {
+  const auto front = bus.queue[bus.first++];
+  if (bus.first == bus.queue.size()) {
+    bus.queue.clear();
+    bus.first = 0;
+  }
+  return front;
+}
+
+void DdcEngine::complete(Transaction& transaction, bool ok, uint32_t current, uint32_t max) {
+  if (transaction.write)
+    listener.writeDone(transaction.context, ok);
+  else
+    listener.readDone(transaction.context, ok, current, max);
+}
+
+void DdcEngine::step(Bus& bus, Clock::time_point& wake) {
+  const auto& front = bus.queue[bus.first];
+  const auto now = Clock::now();
+
+  if (!bus.begun) {
+    if (now >= front.expires) {
+      LOG_WARNING("Gave up waiting to reach {}", front.display->serial());
+      auto expired = pop(bus);
+      wake = now;
+      complete(expired, false, 0, 0);
+      return;
+    }
+    const auto busy = front.display->busyFor();
+    if (busy.count() > 0) {
+      wake = std::min(wake, std::min(now + busy, front.expires));
+      return;
+    }
+    try {
+      bus.due = now + (front.write ? front.display->beginWrite(front.code, front.value) : front.display->beginRead(front.code));
+      bus.begun = true;
+    }
+    catch (std::exception& e) {
+      LOG_WARNING("Could not reach {} {}", front.display->serial(), e.what());
+      auto failed = pop(bus);
+      wake = now;
+      complete(failed, false, 0, 0);
+      return;
+    }
+  }
+
+  if (bus.due > Clock::now()) {
+    wake = std::min(wake, bus.due);
+    return;
+  }
+
+  // off the queue before its callback runs, which may queue more on this bus
+  auto finished = pop(bus);
+  bus.begun = false;
+  // whatever is next on this bus, or queued by the callback, may be ready right away. without
+  // this, a bus waiting on a slow panel would set the only wake up and hold the others back
+  wake = now;
+
+  bool ok = false;
+  uint32_t current = 0, max = 0;
+  try {
+    ok = finished.write ? finished.display->finishWrite(finished.code, finished.value) : finished.display->finishRead(finished.code, current, max);
+  }
+  catch (std::exception& e) {
+    LOG_WARNING("Could not reach {} {}", finished.display->serial(), e.what());
+  }
+  complete(finished, ok, current, max);
+}
+
+bool DdcEngine::run(Clock::time_point deadline) {
+  while (true) {
+    auto wake = Clock::time_point::max();
+    bool idle = true;
+    for (auto& entry : buses) {
+      if (entry.second.queue.size() == entry.second.first)
+        continue;
+      idle = false;
+      step(entry.second, wake);
+    }
+    if (idle)
+      return true;
+
+    const auto now = Clock::now();
+    if (now >= deadline)
+      break;
+    if (wake > now && wake != Clock::time_point::max())
+      std::this_thread::sleep_until(std::min(wake, deadline));
+  }
+
+  // whatever was sent still has to be collected, so its display's bus is released. its answer
+  // came too late and counts as none, the transactions never sent are dropped unanswered
+  for (auto& entry : buses) {
+    auto& bus = entry.second;
+    if (bus.begun) {
+      uint32_t current, max;
+      auto late = pop(bus);
+      bus.begun = false;
+      try {
+        late.write ? late.display->finishWrite(late.code, late.value) : late.display->finishRead(late.code, current, max);
+      }
+      catch (std::exception&) {}
+      complete(late, false, 0, 0);
+    }
+    bus.queue.clear();
+    bus.first = 0;
+  }
+  return false;
+}
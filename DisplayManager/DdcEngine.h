@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+
+#include <chrono>
+#include <map>
+#include <vector>
+
+// Runs DDC transactions for many displays on the calling thread. A transaction is started, and
+// while its panel works out the reply the engine starts or finishes transactions on other buses,
+// sleeping only when every bus is waiting. Displays sharing a bus (see DisplayLocation) take
+// turns, displays without a known bus get one to themselves.
+//
+// Results go to one listener, on the same thread, which may queue follow up transactions, e.g. to
+// poll a display until a write took effect. Queues keep their storage between runs, so once
+// every bus has been seen a run allocates nothing.
+class DdcEngine : NONCOPY {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // told about each transaction as it finishes, with the context it was queued with
+  class Listener {
+  public:
+    virtual void readDone(void* context, bool ok, uint32_t current, uint32_t max) = 0;
+    virtual void writeDone(void* context, bool ok) = 0;
+  protected:
+    ~Listener() {}
+  };
+
+  explicit DdcEngine(Listener& listener);
+
+  // a transaction that couldn't be sent this long after it was queued fails instead of waiting
+  // any longer, e.g. behind a neighbour on its bus. zero, the default, waits as long as it takes.
+  // once sent, the transport's own timeout applies
+  void setOperationTimeout(Clock::duration);
+
+  // the displays were re-enumerated, forget their buses
+  void reset();
+
+  void read(const DisplayObject&, VcpCode code, void* context);
+  void write(const DisplayObject&, VcpCode code, uint32_t value, void* context);
+
+  // until nothing is queued, false if work was left at the deadline. transactions already sent
+  // then fail, the rest are dropped unanswered. callbacks must not count on queueing more by then
+  bool run(Clock::time_point deadline = Clock::time_point::max());
+
+private:
+  struct Transaction {
+    const DisplayObject* display;
+    bool write;
+    VcpCode code;
+    uint32_t value;
+    void* context;
+    Clock::time_point expires;
+  };
+
+  struct Bus {
+    // the queue runs from first, both reset once it drains
+    std::vector<Transaction> queue;
+    size_t first = 0;
+    // the front transaction was sent and its reply is due
+    bool begun = false;
+    Clock::time_point due;
+  };
+
+  // (bus, nullptr) for a known bus, (-1, display) otherwise
+  std::map<std::pair<int, const DisplayObject*>, Bus> buses;
+  Listener& listener;
+  Clock::duration timeout = Clock::duration::zero();
+
+  void queue(Transaction);
+  static Transaction pop(Bus&);
+  // starts or finishes the front transaction if it can, otherwise says when to look again
+  void step(Bus&, Clock::time_point& wake);
+  void complete(Transaction&, bool ok, uint32_t current, uint32_t max);
+};
@@ -0,0 +1,172 @@
+#include "DeskSnapshot.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTimer>
+
+namespace {
+  // 2 stores inputs as numbers, 1 had them as hex text
+  const int format = 2;
+
+  VcpValue readValue(const QJsonValue& value) {
+    if (value.isString())
+      return VcpValue::parse(value.toString().toStdString());
+    return value.isDouble() ? VcpValue(uint16_t(value.toInt())) : VcpValue();
+  }
+
+  QString snapshotPath() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/snapshot.json";
+  }
+}
+
+class DeskSnapshot::Data {
+public:
+  DisplayInfoList displays;
+  std::unordered_map<std::string, VcpValue> inputs;
+  QString profile;
+
+  // a refresh reports every display's input in a burst, written once they're all in
+  QTimer * const flush;
+
+  Data(DeskSnapshot& owner)
+  : flush(new QTimer(&owner))
+  {
+    flush->setSingleShot(true);
+    flush->setInterval(0);
+  }
+
+  void load() {
+    QFile file(snapshotPath());
+    if (!file.open(QIODevice::ReadOnly))
+      return;
+
+    const auto root = QJsonDocument::fromJson(file.readAll()).object();
+    const int found = root.value("format").toInt();
+    if (found < 1 || found > format)
+      return;
+
+    profile = root.value("profile").toString();
+    for (const auto& value : root.value("displays").toArray()) {
+      const auto display = value.toObject();
+      DisplayInfo info;
+      info.serial = display.value("serial").toString().toStdString();
+      info.name = display.value("name").toString();
+      for (const auto& source : display.value("sources").toArray()) {
+        const auto pair = source.toArray();
+        const auto mode = readValue(pair.at(1));
+        if (mode.valid())
+          info.sources.push_back(std::make_pair(pair.at(0).toString().toStdString(), mode));
+      }
+      const auto input = readValue(display.value("input"));
+      if (input.valid())
+        inputs[info.serial] = input;
+      displays.push_back(std::move(info));
+    }
+  }
+
+  void save() const {
+    QJsonArray list;
+    for (auto& info : displays) {
+      QJsonArray sources;
+      for (auto& source : info.sources)
+        sources.append(QJsonArray{ QString::fromStdString(source.first), source.second.value() });
+
+      QJsonObject display;
+      display["serial"] = QString::fromStdString(info.serial);
+      display["name"] = info.name;
+      display["sources"] = sources;
+      const auto input = inputs.find(info.serial);
+      if (input != inputs.end() && input->second.valid())
+        display["input"] = input->second.value();
+      list.append(display);
+    }
+
+    QJsonObject root;
+    root["format"] = format;
+    root["profile"] = profile;
+    root["displays"] = list;
+
+    // written aside and renamed over, a crash mid write keeps the previous snapshot
+    QDir().mkpath(QFileInfo(snapshotPath()).absolutePath());
+    QSaveFile file(snapshotPath());
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson(QJsonDocument::Compact)) < 0 || !file.commit())
+      qWarning() << "Could not save the desk snapshot to" << snapshotPath();
+  }
+
+  void setInput(const std::string& serial, VcpValue input) {
+    auto& known = inputs[serial];
+    if (known == input)
+      return;
+    known = input;
+    flush->start();
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     DeskSnapshot
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+DeskSnapshot::~DeskSnapshot() {
+  if (d().flush->isActive())
+    d().save();
+}
+
+DeskSnapshot::DeskSnapshot(DeviceWorker& worker, QObject* parent)
+: QObject(parent)
+, data(std::make_unique<Data>(*this))
+{
+  d().load();
+
+  bool valid = true;
+  valid &= (bool)connect(d().flush, &QTimer::timeout, this, [this]() { d().save(); });
+  valid &= (bool)connect(&worker, &DeviceWorker::refreshed, this, [this](const DisplayInfoList& displays) {
+    d().displays = displays;
+    // inputs of displays that went away are of no use anymore
+    std::unordered_map<std::string, VcpValue> kept;
+    for (auto& display : displays) {
+      const auto iter = d().inputs.find(display.serial);
+      if (iter != d().inputs.end())
+        kept.insert(*iter);
+    }
+    d().inputs.swap(kept);
+    d().flush->start();
+  });
+  valid &= (bool)connect(&worker, &DeviceWorker::currentRead, this, [this](const std::string& serial, VcpValue input) {
+    d().setInput(serial, input);
+  });
+  valid &= (bool)connect(&worker, &DeviceWorker::inputConfirmed, this, [this](const std::string& serial, VcpValue input) {
+    d().setInput(serial, input);
+  });
+  valid &= (bool)connect(&worker, &DeviceWorker::profileLoaded, this, [this](const QString& name) {
+    if (d().profile == name)
+      return;
+    d().profile = name;
+    d().flush->start();
+  });
+  Q_ASSERT(valid);
+}
+
+const DisplayInfoList& DeskSnapshot::displays() const {
+  return d().displays;
+}
+
+const std::unordered_map<std::string, VcpValue>& DeskSnapshot::inputs() const {
+  return d().inputs;
+}
+
+const QString& DeskSnapshot::profile() const {
+  return d().profile;
+}
+
+bool DeskSnapshot::toggled() const {
+  return d().profile == "profile b";
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "common.h"
+#include "DeviceWorker.h"
+
+#include <QObject>
+#include <QString>
+#include <string>
+#include <unordered_map>
+
+// The last known displays, their inputs and the active profile, saved to a small file whenever
+// they change. A fresh start shows this right away and lets the worker's refresh and reads
+// correct it in the background, instead of waiting on the displays.
+class DeskSnapshot : public QObject {
+  Q_OBJECT
+  PIMPL
+
+public:
+  ~DeskSnapshot();
+  // loads the file, then follows the worker's results
+  DeskSnapshot(DeviceWorker& worker, QObject* parent = Q_NULLPTR);
+
+  const DisplayInfoList& displays() const;
+  // serial -> last input read or confirmed
+  const std::unordered_map<std::string, VcpValue>& inputs() const;
+  // the profile loaded last, empty if none was
+  const QString& profile() const;
+  // whether toggling should go back to "profile a"
+  bool toggled() const;
+};
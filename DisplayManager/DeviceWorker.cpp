@@ -0,0 +1,367 @@
+#include "DeviceWorker.h"
+#include "ActiveControl.h"
+#include "CommandQueue.h"
+#include "DisplayHealth.h"
+#include "IdentityCache.h"
+#include "InputSwitch.h"
+#include "KeepAlive.h"
+#include "LevelSync.h"
+#include "Log.h"
+#include "SettingsWatch.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <functional>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
+#include <QSemaphore>
+#include <QSettings>
+
+class DeviceWorker::Data {
+  using Command = std::function<void()>;
+
+public:
+  DeviceWorker& owner;
+
+  CommandQueue<Command> queue;
+  QSemaphore pending;
+
+  // only touched from the worker thread
+  bool running = true;
+  DisplayCollection collection;
+  LevelSync levels;
+  KeepAlive keepalive;
+  ActiveControl active;
+  DisplayHealth health;
+  InputSwitch switcher;
+  // kept from one switch to the next, like everything inside switcher
+  std::vector<InputSwitch::Target> targets;
+  // profiles as last read, resolved against the displays. The window and the daemon may both
+  // save them, so they're dropped on refresh, on save, and whenever the settings changed
+  std::map<QString, std::vector<InputSwitch::Target>> profiles;
+  SettingsWatch watch;
+
+  std::thread thread;
+
+  void run() {
+    TRACE_THREAD("device worker");
+    while (running) {
+      // level ramps, keep alive reads, active control polls and quarantine probes happen in
+      // between commands, never delaying one for long
+      auto wait = keepalive.step(collection.get(), health);
+      wait = std::min(wait, active.step(collection.get(), health, [this](const DisplayObject& device, VcpCode code, uint32_t current, uint32_t) {
+        panelChanged(device, code, current);
+      }));
+      wait = std::min(wait, health.step(collection.get(), [this](const DisplayObject& device, VcpValue input) {
+        emit owner.currentRead(device.serial(), input);
+      }));
+      if (!levels.idle())
+        wait = std::min(wait, levels.step(collection.get(), health));
+      if (wait == std::chrono::milliseconds::max())
+        pending.acquire();
+      else if (!pending.tryAcquire(1, int(std::min<std::chrono::milliseconds::rep>(wait.count(), INT_MAX))))
+        continue;
+
+      // a producer can be mid push when its neighbour has already signaled
+      Command command;
+      while (!queue.pop(command))
+        std::this_thread::yield();
+
+      try {
+        command();
+      }
+      catch (std::exception& e) {
+        LOG_WARNING("Device command failed: {}", e.what());
+        emit owner.failed(QString(e.what()));
+      }
+    }
+  }
+
+  ~Data() {
+    post([this]() { running = false; });
+    thread.join();
+  }
+  Data(DeviceWorker& _owner, std::shared_ptr<DisplayBackend> backend)
+  : owner(_owner)
+  , collection(std::move(backend))
+  , switcher(health)
+  {
+    QSettings settings;
+    settings.beginGroup("KeepAlive");
+    keepalive.configure(std::chrono::seconds(settings.value("interval", 0).toInt()), settings.value("budget", 30).toInt());
+    settings.endGroup();
+    settings.beginGroup("ActiveControl");
+    active.configure(std::chrono::milliseconds(settings.value("interval", 1000).toInt()));
+    settings.endGroup();
+    settings.beginGroup("Health");
+    health.configure(settings.value("failures", 3).toInt(), std::chrono::milliseconds(settings.value("window", 2000).toInt()),
+      std::chrono::milliseconds(settings.value("probe", 5000).toInt()));
+    switcher.configure(std::chrono::milliseconds(settings.value("switch_deadline", 5000).toInt()),
+      std::chrono::milliseconds(settings.value("operation_timeout", 2000).toInt()));
+    settings.endGroup();
+
+    thread = std::thread([this]() { run(); });
+  }
+
+  void post(Command command) {
+    queue.push(std::move(command));
+    pending.release();
+  }
+
+  // for the commands callers wait on: each ends in its own completion signal, or in
+  // commandFailed if it threw, so replies can be matched to commands in order
+  template<typename Call>
+  void answer(Call call) {
+    try {
+      call();
+    }
+    catch (std::exception& e) {
+      LOG_WARNING("Device command failed: {}", e.what());
+      emit owner.failed(QString(e.what()));
+      emit owner.commandFailed(QString(e.what()));
+    }
+  }
+
+  // someone used the panel's own buttons
+  void panelChanged(const DisplayObject& device, VcpCode code, uint32_t current) {
+    if (code != VcpCode::input_source)
+      return;
+    const auto input = VcpValue(uint16_t(current));
+    LOG_INFO("Input changed on the panel to: {x}", input.value());
+    emit owner.currentRead(device.serial(), input);
+  }
+
+  const DisplayObject* find(const std::string& serial) const {
+    return collection.find(serial);
+  }
+
+  DisplayInfo describe(QSettings& settings, const DisplayObject& device) {
+    DisplayInfo info;
+    info.serial = device.serial();
+    info.name = QString::fromStdWString(device.name());
+
+    const auto group = QString::fromStdString(info.serial);
+    // a direct key lookup, listing every group would make a wall of displays quadratic
+    const bool known = settings.contains(group + "/name");
+    settings.beginGroup(group);
+
+    // we try to load inputs from file, because querying the monitor for them is incredibly slow
+    if (known) {
+      info.name = settings.value("name").toString();
+      settings.beginGroup("sources");
+      for (const auto& input_name : settings.childKeys()) {
+        // stored as text, the way capabilities strings write them
+        const auto input_mode = VcpValue::parse(settings.value(input_name).toString().toStdString());
+        if (input_mode.valid())
+          info.sources.push_back(std::make_pair(input_name.toStdString(), input_mode));
+      }
+      settings.endGroup();
+    }
+    else {
+      settings.setValue("name", info.name);
+
+      bool active_control = false;
+      info.sources = device.sources(&active_control);
+      settings.setValue("active_control", active_control);
+
+      settings.beginGroup("sources");
+      for (auto& pair : info.sources)
+        settings.setValue(QString::fromStdString(pair.first), QString::fromStdString(pair.second.toString()));
+      settings.endGroup();
+    }
+
+    settings.endGroup();
+    return info;
+  }
+
+  void doRefresh() {
+    TRACE_SCOPE("refresh");
+    collection.refresh();
+    levels.reset();
+    health.reset(collection.get());
+    switcher.reset();
+    profiles.clear();
+    storeIdentities(collection);
+
+    QSettings settings;
+    std::unordered_map<std::string, std::string> groups;
+    std::unordered_map<std::string, bool> advertised;
+    DisplayInfoList result;
+    for (auto& device : collection.get()) {
+      result.push_back(describe(settings, device));
+      const auto key = QString::fromStdString(device.serial());
+      const auto group = settings.value(key + "/group").toString();
+      if (!group.isEmpty())
+        groups.emplace(device.serial(), group.toStdString());
+      // displays described before this was stored are probed instead
+      const auto active_control = settings.value(key + "/active_control");
+      if (!active_control.isNull())
+        advertised.emplace(device.serial(), active_control.toBool());
+    }
+    collection.setGroups(std::move(groups));
+    active.reset(std::move(advertised));
+
+    emit owner.refreshed(result);
+  }
+
+  void doReadCurrent(const std::string& serial) {
+    TRACE_SCOPE("readCurrent");
+    const auto* device = find(serial);
+    if (!device || health.quarantined(*device))
+      return;
+
+    const auto value = device->current();
+    value.valid() ? health.succeeded(*device) : health.failed(*device);
+    LOG_DEBUG("Current Input: {x}", value.value());
+    emit owner.currentRead(serial, value);
+  }
+
+  void doSelectInput(const std::string& serial, VcpValue input) {
+    const auto* device = find(serial);
+    if (!device)
+      return;
+
+    TRACE_SCOPE("selectInput");
+    LOG_INFO("Input Changed to: {x}", input.value());
+    targets.clear();
+    targets.push_back(std::make_pair(device, input));
+    const auto& result = switcher.run(targets, false).front();
+    if (result.outcome == SwitchResult::confirmed) {
+      LOG_INFO("Input change took {} seconds.", result.seconds);
+      emit owner.inputConfirmed(serial, input, result.seconds);
+    }
+    else if (result.input.valid()) {
+      emit owner.currentRead(serial, result.input);
+    }
+  }
+
+  void doSaveProfile(const QString& name) {
+    TRACE_SCOPE("saveProfile");
+    QSettings settings;
+    settings.beginGroup("profiles");
+    settings.beginGroup(name);
+    for (auto& device : collection.get()) {
+      if (health.quarantined(device)) {
+        LOG_WARNING("Left {} out of the profile, it isn't answering", device.serial());
+        continue;
+      }
+      try {
+        settings.setValue(QString::fromStdString(device.serial()), QString::fromStdString(device.current().toString()));
+      }
+      catch (std::exception& e) {
+        LOG_WARNING("Could not read {} {}", device.serial(), e.what());
+      }
+    }
+    settings.endGroup();
+    settings.endGroup();
+    profiles.erase(name);
+
+    emit owner.profileSaved(name);
+  }
+
+  // profiles are kept as text, the way they always were
+  std::vector<InputSwitch::Target> readProfile(const QString& name) {
+    std::vector<InputSwitch::Target> result;
+    QSettings settings;
+    settings.beginGroup("profiles");
+    settings.beginGroup(name);
+    for (auto& device : collection.get()) {
+      const auto value = VcpValue::parse(settings.value(QString::fromStdString(device.serial())).toString().toStdString());
+      if (!value.valid())
+        continue;
+      result.push_back(std::make_pair(&device, value));
+    }
+    settings.endGroup();
+    settings.endGroup();
+    return result;
+  }
+
+  void doLoadProfile(const QString& name) {
+    TRACE_SCOPE("loadProfile");
+    if (watch.changed())
+      profiles.clear();
+    auto profile = profiles.find(name);
+    if (profile == profiles.end())
+      profile = profiles.emplace(name, readProfile(name)).first;
+
+    const auto& results = switcher.run(profile->second, true);
+    for (auto& result : results) {
+      if (result.input.valid())
+        emit owner.currentRead(result.serial, result.input);
+    }
+
+    emit owner.switchReported(name, results);
+    emit owner.profileLoaded(name);
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     DeviceWorker
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+DeviceWorker::~DeviceWorker() {}
+
+DeviceWorker::DeviceWorker(QObject* parent)
+: DeviceWorker(nullptr, parent)
+{}
+
+DeviceWorker::DeviceWorker(std::shared_ptr<DisplayBackend> backend, QObject* parent)
+: QObject(parent)
+{
+  qRegisterMetaType<std::string>("std::string");
+  qRegisterMetaType<std::wstring>("std::wstring");
+  qRegisterMetaType<VcpValue>("VcpValue");
+  qRegisterMetaType<DisplayInfoList>("DisplayInfoList");
+  qRegisterMetaType<SwitchResultList>("SwitchResultList");
+  qRegisterMetaType<hubList>("hubList");
+
+  data = std::make_unique<Data>(*this, std::move(backend));
+}
+
+void DeviceWorker::refresh() {
+  d().post([this]() { d().answer([this]() { d().doRefresh(); }); });
+}
+
+void DeviceWorker::readCurrent(const std::string& serial) {
+  d().post([this, serial]() { d().doReadCurrent(serial); });
+}
+
+void DeviceWorker::selectInput(const std::string& serial, VcpValue input) {
+  d().post([this, serial, input]() { d().doSelectInput(serial, input); });
+}
+
+void DeviceWorker::saveProfile(const QString& name) {
+  d().post([this, name]() { d().answer([this, name]() { d().doSaveProfile(name); }); });
+}
+
+void DeviceWorker::loadProfile(const QString& name) {
+  d().post([this, name]() { d().answer([this, name]() { d().doLoadProfile(name); }); });
+}
+
+void DeviceWorker::setLevel(VcpCode code, double level, int ramp_ms) {
+  d().post([this, code, level, ramp_ms]() { d().levels.target(code, level, std::chrono::milliseconds(ramp_ms)); });
+}
+
+void DeviceWorker::prewarm() {
+  d().post([this]() { d().keepalive.prewarm(); });
+}
+
+void DeviceWorker::pollHub(const std::wstring& hub) {
+  d().post([this, hub]() {
+    TRACE_SCOPE("pollHub");
+    emit hubPolled(hub, isUSBConnected(hub));
+  });
+}
+
+void DeviceWorker::listHubs() {
+  d().post([this]() {
+    TRACE_SCOPE("listHubs");
+    emit hubsListed(getConnectedUSB());
+  });
+}
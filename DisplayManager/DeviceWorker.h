@@ -0,0 +1,73 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+#include "InputSwitch.h"
+#include "USBWatcher.h"
+
+#include <QObject>
+#include <QMetaType>
+#include <QString>
+
+// everything the gui needs to know about a display, without touching the device
+struct DisplayInfo {
+  std::string serial;
+  QString name;
+  DisplayObject::sourceList sources;
+};
+
+using DisplayInfoList = std::vector<DisplayInfo>;
+
+// Owns the DisplayCollection and performs every DDC, WMI and capabilities call on a
+// dedicated thread. Commands may be posted from any thread and return immediately,
+// results are delivered through signals (queued onto the receiver's thread).
+class DeviceWorker : public QObject {
+  Q_OBJECT
+  PIMPL
+
+public:
+  ~DeviceWorker();
+  DeviceWorker(QObject* parent = Q_NULLPTR);
+  DeviceWorker(std::shared_ptr<DisplayBackend> backend, QObject* parent = Q_NULLPTR);
+
+  void refresh();
+  void readCurrent(const std::string& serial);
+  void selectInput(const std::string& serial, VcpValue input);
+
+  void saveProfile(const QString& name);
+  // writes every display, then waits for each to report the new input (up to the switch
+  // deadline) before switchReported and profileLoaded. Profiles are read from the settings
+  // once, and again only after a save, a refresh or a change to the settings by any process
+  void loadProfile(const QString& name);
+
+  // ramps a continuous control (brightness, contrast) on every display to the same fraction of
+  // its range, in between other commands
+  void setLevel(VcpCode code, double level, int ramp_ms = 0);
+
+  // wakes displays that may have dozed off, ahead of a likely switch, within the keep alive budget
+  void prewarm();
+
+  void pollHub(const std::wstring& hub);
+  void listHubs();
+
+signals:
+  void refreshed(const DisplayInfoList&);
+  void currentRead(const std::string& serial, VcpValue input);
+  void inputConfirmed(const std::string& serial, VcpValue input, double seconds);
+  void profileSaved(const QString& name);
+  void switchReported(const QString& name, const SwitchResultList&);
+  void profileLoaded(const QString& name);
+  void hubPolled(const std::wstring& hub, bool connected);
+  void hubsListed(const hubList&);
+  void failed(const QString& reason);
+  // a refresh, profile save or profile load threw, in place of refreshed, profileSaved or
+  // profileLoaded (after failed)
+  void commandFailed(const QString& reason);
+};
+
+Q_DECLARE_METATYPE(std::string)
+Q_DECLARE_METATYPE(std::wstring)
+Q_DECLARE_METATYPE(VcpValue)
+Q_DECLARE_METATYPE(DisplayInfoList)
+Q_DECLARE_METATYPE(SwitchResultList)
+Q_DECLARE_METATYPE(hubList)
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "monitors.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// the DDC/CI channel of one physical panel
+class DisplayTransport {
+public:
+  struct Reply {
+    bool ok;
+    uint32_t current;
+    uint32_t max;
+  };
+
+  virtual ~DisplayTransport() {}
+
+  // empty if the panel didn't answer
+  virtual std::string capabilities() = 0;
+
+  // the piece of the capabilities string starting at offset, as one DDC reply carries it, and an
+  // empty fragment once the string is complete. false if the reply was lost or corrupted, the same
+  // offset can simply be asked for again. transports that can only fetch the whole string at once
+  // hand it out as a single fragment
+  virtual bool capabilitiesFragment(uint16_t offset, std::string& fragment) {
+    if (offset > 0) {
+      fragment.clear();
+      return true;
+    }
+    fragment = capabilities();
+    return !fragment.empty();
+  }
+  virtual Reply getVCP(uint8_t code) = 0;
+  virtual bool setVCP(uint8_t code, uint32_t value) = 0;
+
+  // split phase requests, so one thread can keep many buses busy (see DdcEngine). begin sends
+  // the request and returns how long the panel needs before finish may collect the reply and
+  // free the bus. the defaults make the whole blocking call in finish
+  virtual std::chrono::microseconds beginGetVCP(uint8_t /*code*/) { return std::chrono::microseconds(0); }
+  virtual Reply finishGetVCP(uint8_t code) { return getVCP(code); }
+  virtual std::chrono::microseconds beginSetVCP(uint8_t /*code*/, uint32_t /*value*/) { return std::chrono::microseconds(0); }
+  virtual bool finishSetVCP(uint8_t code, uint32_t value) { return setVCP(code, value); }
+  // how long until the bus may carry the next request, for transports that pace themselves
+  virtual std::chrono::microseconds busyFor() { return std::chrono::microseconds(0); }
+};
+
+// finds the displays attached to the system and builds their DisplayObjects
+class DisplayBackend {
+public:
+  virtual ~DisplayBackend() {}
+
+  virtual void enumerate(devices& result) = 0;
+  // see DisplayCollection::refreshCached
+  virtual bool enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) = 0;
+
+  // the native backend (dxva2 on windows, i2c-dev on linux), or the simulator when DISPLAYMANAGER_SIMULATOR is set
+  // (always the simulator on platforms without a native backend), recorded when
+  // DISPLAYMANAGER_RECORD is set. DISPLAYMANAGER_REPLAY plays a recording back instead
+  static std::shared_ptr<DisplayBackend> create();
+};
@@ -0,0 +1,135 @@
+#include "DisplayHealth.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+class DisplayHealth::Data {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static const milliseconds max_probe;
+
+  struct State {
+    int failures = 0;
+    Clock::time_point first_failure;
+    bool quarantined = false;
+    milliseconds backoff{ 0 };
+    Clock::time_point next_probe;
+  };
+
+  int failures = 3;
+  milliseconds window{ 2000 };
+  milliseconds probe{ 5000 };
+  // one per display from reset on, so a panel failing while it resyncs after every switch
+  // doesn't allocate its state each time
+  std::unordered_map<std::string, State> states;
+  int quarantined = 0;
+
+  const State* find(const DisplayObject& device) const {
+    const auto iter = states.find(device.serial());
+    return iter != states.end() ? &iter->second : nullptr;
+  }
+
+  void quarantine(const DisplayObject& device, State& state, Clock::time_point now) {
+    state.quarantined = true;
+    ++quarantined;
+    state.backoff = probe;
+    state.next_probe = now + probe;
+    LOG_WARNING("{} stopped answering, leaving it out until it does", device.serial());
+  }
+};
+
+const DisplayHealth::milliseconds DisplayHealth::Data::max_probe(60000);
+
+DisplayHealth::~DisplayHealth() {}
+
+DisplayHealth::DisplayHealth()
+: data(std::make_unique<Data>())
+{}
+
+void DisplayHealth::configure(int failures, milliseconds window, milliseconds probe) {
+  d().failures = std::max(1, failures);
+  d().window = std::max(milliseconds::zero(), window);
+  d().probe = std::max(milliseconds(100), probe);
+}
+
+void DisplayHealth::reset(const devices& displays) {
+  d().states.clear();
+  d().quarantined = 0;
+  for (auto& device : displays)
+    d().states.emplace(device.serial(), Data::State());
+}
+
+bool DisplayHealth::quarantined(const DisplayObject& device) const {
+  const auto* state = d().find(device);
+  return state && state->quarantined;
+}
+
+void DisplayHealth::succeeded(const DisplayObject& device) {
+  const auto iter = d().states.find(device.serial());
+  if (iter == d().states.end())
+    return;
+  if (iter->second.quarantined) {
+    LOG_INFO("{} is answering again", device.serial());
+    --d().quarantined;
+  }
+  iter->second = Data::State();
+}
+
+void DisplayHealth::failed(const DisplayObject& device) {
+  const auto now = Data::Clock::now();
+  auto& state = d().states[device.serial()];
+  if (state.quarantined)
+    return;
+  // a failure long after the first of a run starts a new run
+  if (state.failures == 0 || (d().window > milliseconds::zero() && now - state.first_failure > d().window)) {
+    state.failures = 0;
+    state.first_failure = now;
+  }
+  if (++state.failures >= d().failures)
+    d().quarantine(device, state, now);
+}
+
+DisplayHealth::milliseconds DisplayHealth::step(const devices& displays, const Recovered& recovered) {
+  if (d().quarantined == 0)
+    return milliseconds::max();
+
+  const auto now = Data::Clock::now();
+  const DisplayObject* next = nullptr;
+  Data::State* next_state = nullptr;
+  for (auto& device : displays) {
+    const auto iter = d().states.find(device.serial());
+    if (iter == d().states.end() || !iter->second.quarantined)
+      continue;
+    if (!next_state || iter->second.next_probe < next_state->next_probe) {
+      next = &device;
+      next_state = &iter->second;
+    }
+  }
+  if (!next)
+    return milliseconds::max();
+  if (next_state->next_probe > now)
+    return std::chrono::duration_cast<milliseconds>(next_state->next_probe - now) + milliseconds(1);
+
+  // one probe per step, so a display that still doesn't answer holds the worker for one timeout
+  TRACE_DISPLAY_SCOPE("probe", next->traceTrack());
+  uint32_t current = 0, max = 0;
+  bool ok = false;
+  try {
+    ok = next->readRange(VcpCode::input_source, current, max);
+  }
+  catch (std::exception&) {}
+
+  if (ok) {
+    succeeded(*next);
+    recovered(*next, VcpValue(uint16_t(current)));
+  }
+  else {
+    next_state->backoff = std::min(next_state->backoff * 2, Data::max_probe);
+    next_state->next_probe = Data::Clock::now() + next_state->backoff;
+  }
+  return milliseconds(0);
+}
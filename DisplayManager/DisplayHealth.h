@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+// A circuit breaker per display, so one that stopped answering doesn't hold up the rest. A
+// display that fails `failures` times in a row within `window` (0 for no limit) is quarantined:
+// switches and reads skip it and report it as such. Callers don't report the reads a panel
+// misses while it resyncs after an input change. While quarantined it gets one probe read of its input at a time, spaced
+// out from `probe` doubling to a minute, and the first answer lets it back in.
+// Only called from the device worker thread.
+class DisplayHealth : NONCOPY {
+  PIMPL
+
+public:
+  using milliseconds = std::chrono::milliseconds;
+  // a quarantined display answered a probe with its current input
+  using Recovered = std::function<void(const DisplayObject&, VcpValue input)>;
+
+  ~DisplayHealth();
+  DisplayHealth();
+
+  void configure(int failures, milliseconds window, milliseconds probe);
+  // the displays were re-enumerated, every one gets a clean slate
+  void reset(const devices& displays);
+
+  bool quarantined(const DisplayObject&) const;
+  void succeeded(const DisplayObject&);
+  void failed(const DisplayObject&);
+
+  // probes the quarantined display that is due, returns how long until the next one is
+  milliseconds step(const devices& displays, const Recovered& recovered);
+};
@@ -1,135 +1,112 @@
 #include "DisplayManager.h"
-#include "monitors.h"
-#include "USBWatcher.h"
+#include "DeskSnapshot.h"
+#include "DeviceWorker.h"
+#include "GlobalHotkeys.h"
+#include "HubWatch.h"
+#include "Log.h"
+#include "PeerLink.h"
 
-#include <QDebug>
 #include <QPushButton>
 #include <QSettings>
 #include <QShortcut>
-#include <QStandardItemModel>
-#include <QTimer>
+#include <QAbstractListModel>
 
+#include <atomic>
 #include <unordered_map>
 
 #include "ui_HubModal.h"
 
-class InputModel : public QStandardItemModel {
+// the inputs of whichever display is selected, swapped wholesale on selection
+class InputModel : public QAbstractListModel {
   Q_OBJECT
 
-  const DisplayObject& config;
-  QStandardItem * const device_item;
-  QString name;
+  std::string device;
+  DisplayObject::sourceList inputs;
+  std::unordered_map<VcpValue, int> rows;
 
 public:
-  InputModel(const DisplayObject&, QStandardItem*, QObject*);
+  InputModel(QObject* parent);
   ~InputModel() = default;
 
-  
-  std::vector<std::string> values;
-  
-  std::string& rowName(const QModelIndex& qidx) {
-    return values.at(qidx.row());
-  }
-  void selectInput(const QModelIndex& qidx) {
-    const auto& input_name = rowName(qidx);
-    qDebug() << "Input Changed to:" << QString::fromStdString(input_name);
-    config.setInput(input_name);
+  void show(const DisplayInfo*);
+
+  const std::string& serial() const {
+    return device;
   }
-  void selectInput(const std::string& s) {
-    qDebug() << "Input Changed to:" << QString::fromStdString(s);
-    config.setInput(s);
+  const DisplayObject::sourceList& sources() const {
+    return inputs;
   }
-  QModelIndex getCurrent() {
-    auto value = config.current();
-    qDebug() << "Current Input:" << QString::fromStdString(value);
-    for (int i = 0; i < values.size(); ++i) {
-      if(values[i] == value)
-        return invisibleRootItem()->child(i,0)->index();
-    }
-    return QModelIndex();
+  VcpValue rowName(const QModelIndex& qidx) const {
+    return inputs.at(qidx.row()).second;
   }
-
-  const QString& getName() {
-    return name;
+  QModelIndex indexOf(VcpValue value) const {
+    const auto iter = rows.find(value);
+    return iter != rows.end() ? index(iter->second) : QModelIndex();
   }
-  void setName(const QString& _name) {
-    name = _name;
 
-    device_item->setText(name);
-
-    QSettings settings;
-    const auto group = QString::fromStdString(config.serial());
-    settings.beginGroup(group);
-    settings.setValue("name", name);
-    settings.endGroup();
-  }
-  const DisplayObject& display() const {
-    return config;
-  }
+  virtual int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+  virtual QVariant data(const QModelIndex& qidx, int role) const override;
 };
 
-InputModel::InputModel(const DisplayObject& _config, QStandardItem* _item, QObject* parent)
-: QStandardItemModel(parent)
-, config(_config)
-, device_item(_item)
-, name(QString::fromStdWString(config.name()))
-{
-  QStandardItem *parentItem = invisibleRootItem();
-
-  QSettings settings;
-  const auto group = QString::fromStdString(config.serial());
-  const bool known = settings.childGroups().contains(group);
-  settings.beginGroup(group);
-
-  // we try to load inputs from file, because querying the monitor for them is incredibly slow
-  if( known ) {
-    name = settings.value("name").toString();
-    device_item->setText(name);
-    settings.beginGroup("sources");
-    for(const auto& input_name : settings.childKeys()) {
-      const auto input_mode = settings.value(input_name).toString().toStdString();
-
-      QStandardItem *item = new QStandardItem(input_name);
-      parentItem->appendRow(item);
-      values.push_back(input_mode);
-    }
-    settings.endGroup();
-  }
-  else {
-    settings.setValue("name", name);
+InputModel::InputModel(QObject* parent)
+: QAbstractListModel(parent)
+{}
 
-    settings.beginGroup("sources");
-    for (auto& pair : config.sources()) {
-      QStandardItem *item = new QStandardItem(QString::fromStdString(pair.first));
-      parentItem->appendRow(item);
-      values.push_back(pair.second);
+void InputModel::show(const DisplayInfo* info) {
+  beginResetModel();
+  device = info ? info->serial : std::string();
+  inputs = info ? info->sources : DisplayObject::sourceList();
+  rows.clear();
+  for (int i = 0; i < (int)inputs.size(); ++i)
+    rows.emplace(inputs[i].second, i);
+  endResetModel();
+}
 
-      settings.setValue(QString::fromStdString(pair.first),QString::fromStdString(pair.second));
-    }
-    settings.endGroup();
-  }
+int InputModel::rowCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : (int)inputs.size();
+}
 
-  settings.endGroup();
+QVariant InputModel::data(const QModelIndex& qidx, int role) const {
+  if (!qidx.isValid() || qidx.row() >= (int)inputs.size() || role != Qt::DisplayRole)
+    return QVariant();
+  return QString::fromStdString(inputs[qidx.row()].first);
 }
 
-class DeviceModel : public QStandardItemModel {
+// mirrors the worker's view of the displays, a refresh only touches the rows that changed
+class DeviceModel : public QAbstractListModel {
   Q_OBJECT
 
-  std::vector<InputModel*> known_devices;
-  std::vector<std::string> profile_a;
-  std::vector<std::string> profile_b;
-  bool profile_toggle = false;
+  struct Entry {
+    DisplayInfo info;
+    // last input the worker reported, not valid until one is read
+    VcpValue current;
+  };
 
-  
+  DeviceWorker& worker;
 
-  DisplayCollection collection;
+  std::vector<Entry> entries;
+  std::unordered_map<std::string, int> rows;
+  // flipped from the hotkey thread as well
+  std::atomic<bool> profile_toggle{ false };
+
+  void reindex();
 
 public:
-  DeviceModel(QObject* parent);
+  DeviceModel(DeviceWorker& worker, QObject* parent);
   ~DeviceModel() = default;
 
-  void scan();
-  InputModel* get_device(const QModelIndex&);
+  void populate(const DisplayInfoList&);
+  const DisplayInfo& get_device(const QModelIndex&) const;
+  const DisplayInfo* find(const std::string& serial) const;
+
+  VcpValue current(const std::string& serial) const;
+  void setCurrent(const std::string& serial, VcpValue input);
+  // whether the next toggle goes back to "profile a"
+  void setToggled(bool);
+  void setName(const QModelIndex&, const QString&);
+
+  virtual int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+  virtual QVariant data(const QModelIndex& qidx, int role) const override;
 
   void save_profile(const QString& name);
   void load_profile(const QString& name);
@@ -139,59 +116,123 @@ public:
   void toggle_profile();
 };
 
-DeviceModel::DeviceModel(QObject* parent)
-: QStandardItemModel(parent)
+DeviceModel::DeviceModel(DeviceWorker& _worker, QObject* parent)
+: QAbstractListModel(parent)
+, worker(_worker)
 {}
 
-void DeviceModel::scan() {
-  clear();
-  for (auto& device : known_devices)
-    delete device;
-  known_devices.clear();
-  profile_a.clear();
-  profile_b.clear();
-  profile_toggle = false;
+void DeviceModel::reindex() {
+  rows.clear();
+  for (int i = 0; i < (int)entries.size(); ++i)
+    rows.emplace(entries[i].info.serial, i);
+}
 
-  collection.refresh();
-  
-  QStandardItem *parentItem = invisibleRootItem();
-  for (auto& device : collection.get()) {
-    QStandardItem *item = new QStandardItem(QString::fromStdWString(device.name()));
-    parentItem->appendRow(item);
-    known_devices.push_back(new InputModel(device, item, this));
+void DeviceModel::populate(const DisplayInfoList& displays) {
+  std::unordered_map<std::string, const DisplayInfo*> incoming;
+  for (auto& display : displays)
+    incoming.emplace(display.serial, &display);
+
+  // displays that went away, back to front so the remaining rows stay put
+  for (int row = (int)entries.size() - 1; row >= 0; --row) {
+    if (incoming.count(entries[row].info.serial))
+      continue;
+    beginRemoveRows(QModelIndex(), row, row);
+    entries.erase(entries.begin() + row);
+    endRemoveRows();
+  }
+  reindex();
+
+  std::vector<const DisplayInfo*> added;
+  for (auto& display : displays) {
+    const auto iter = rows.find(display.serial);
+    if (iter == rows.end()) {
+      added.push_back(&display);
+      continue;
+    }
+    auto& entry = entries[iter->second];
+    if (entry.info.name == display.name && entry.info.sources == display.sources)
+      continue;
+    entry.info = display;
+    emit dataChanged(index(iter->second), index(iter->second));
+  }
+
+  if (!added.empty()) {
+    const int first = (int)entries.size();
+    beginInsertRows(QModelIndex(), first, first + (int)added.size() - 1);
+    for (auto* display : added)
+      entries.push_back(Entry{ *display, VcpValue() });
+    reindex();
+    endInsertRows();
   }
-    
 }
 
-InputModel* DeviceModel::get_device(const QModelIndex& qidx) {
-  return known_devices.at(qidx.row());
+const DisplayInfo& DeviceModel::get_device(const QModelIndex& qidx) const {
+  return entries.at(qidx.row()).info;
 }
 
-void DeviceModel::save_profile(const QString& name) {
+const DisplayInfo* DeviceModel::find(const std::string& serial) const {
+  const auto iter = rows.find(serial);
+  return iter != rows.end() ? &entries[iter->second].info : nullptr;
+}
+
+VcpValue DeviceModel::current(const std::string& serial) const {
+  const auto iter = rows.find(serial);
+  return iter != rows.end() ? entries[iter->second].current : VcpValue();
+}
+
+void DeviceModel::setCurrent(const std::string& serial, VcpValue input) {
+  const auto iter = rows.find(serial);
+  if (iter == rows.end() || entries[iter->second].current == input)
+    return;
+  entries[iter->second].current = input;
+  emit dataChanged(index(iter->second), index(iter->second), { Qt::ToolTipRole });
+}
+
+void DeviceModel::setToggled(bool toggled) {
+  profile_toggle = toggled;
+}
+
+void DeviceModel::setName(const QModelIndex& qidx, const QString& name) {
+  if (!qidx.isValid())
+    return;
+  auto& info = entries.at(qidx.row()).info;
+  info.name = name;
 
   QSettings settings;
-  settings.beginGroup("profiles");
-  settings.beginGroup(name);
-  for(auto& device : known_devices) {
-    settings.setValue(QString::fromStdString(device->display().serial()),QString::fromStdString(device->display().current()));
-  }
-  settings.endGroup();
+  settings.beginGroup(QString::fromStdString(info.serial));
+  settings.setValue("name", name);
   settings.endGroup();
+
+  emit dataChanged(qidx, qidx, { Qt::DisplayRole });
 }
-void DeviceModel::load_profile(const QString& name) {
-  QSettings settings;
-  settings.beginGroup("profiles");
-  settings.beginGroup(name);
 
-  for(auto& device : known_devices) {
-    const auto value = settings.value(QString::fromStdString(device->display().serial()));
-    if(value.isNull())
-      continue;
-    device->selectInput(value.toString().toStdString());
+int DeviceModel::rowCount(const QModelIndex& parent) const {
+  return parent.isValid() ? 0 : (int)entries.size();
+}
+
+QVariant DeviceModel::data(const QModelIndex& qidx, int role) const {
+  if (!qidx.isValid() || qidx.row() >= (int)entries.size())
+    return QVariant();
+
+  const auto& entry = entries[qidx.row()];
+  if (role == Qt::DisplayRole)
+    return entry.info.name;
+  if (role == Qt::ToolTipRole) {
+    QString input = QString::fromStdString(entry.current.toString());
+    for (auto& source : entry.info.sources) {
+      if (source.second == entry.current)
+        input = QString::fromStdString(source.first);
+    }
+    return QString::fromStdString(entry.info.serial) + (input.isEmpty() ? QString() : " - " + input);
   }
+  return QVariant();
+}
 
-  settings.endGroup();
-  settings.endGroup();
+void DeviceModel::save_profile(const QString& name) {
+  worker.saveProfile(name);
+}
+void DeviceModel::load_profile(const QString& name) {
+  worker.loadProfile(name);
 }
 
 void DeviceModel::save_a() {
@@ -203,8 +244,9 @@ void DeviceModel::save_b() {
 }
 
 void DeviceModel::toggle_profile() {
-  load_profile(profile_toggle ? QString("profile a") : QString("profile b"));
-  profile_toggle = !profile_toggle;
+  bool was = profile_toggle.load();
+  while (!profile_toggle.compare_exchange_weak(was, !was)) {}
+  load_profile(was ? QString("profile a") : QString("profile b"));
 }
 
 class HubDialog : public QDialog {
@@ -212,16 +254,19 @@ class HubDialog : public QDialog {
 
   Ui::HubSelectWindowClass ui;
 
+  DeviceWorker& worker;
   hubList list;
   std::wstring& watched;
 public:
-  HubDialog(QWidget* parent, std::wstring& _watched) 
+  HubDialog(QWidget* parent, DeviceWorker& _worker, std::wstring& _watched) 
   : QDialog(parent) 
+  , worker(_worker)
   , watched(_watched) {
     ui.setupUi(this);
 
     connect(ui.option->button(QDialogButtonBox::Discard), &QPushButton::released, this, &HubDialog::reset);
     connect(ui.option->button(QDialogButtonBox::Apply), &QPushButton::released, this, &HubDialog::apply);
+    connect(&worker, &DeviceWorker::hubsListed, this, &HubDialog::populate);
 
     ui.option->button(QDialogButtonBox::Discard)->setAutoDefault(false);
     ui.option->button(QDialogButtonBox::Close)->setAutoDefault(false);
@@ -239,7 +284,13 @@ public:
     return QDialog::exec();
   }
   void reset() {
-    list = getConnectedUSB();
+    // the usb query is slow, the list fills in once the worker answers
+    list.clear();
+    ui.listWidget->clear();
+    worker.listHubs();
+  }
+  void populate(const hubList& result) {
+    list = result;
     ui.listWidget->clear();
     int r = 0;
     bool found = false;
@@ -257,8 +308,9 @@ public:
       ui.listWidget->setCurrentRow(0);
   }
   void apply() {
-    watched = list.empty() ? L"" : list[ui.listWidget->currentRow()].first;
-    qDebug() << "Hub Selected: " << watched;
+    const int row = ui.listWidget->currentRow();
+    watched = (list.empty() || row < 0) ? L"" : list[row].first;
+    LOG_DEBUG("Hub Selected: {}", watched);
     QSettings settings;
     settings.setValue("Hub",QString::fromStdWString(watched));
     close();
@@ -270,12 +322,17 @@ class DisplayManager::Data : public QObject {
   Q_OBJECT
   DisplayManager& owner;
 
+  DeviceWorker* const worker;
+  DeskSnapshot* const snapshot;
   DeviceModel* const devices;
+  InputModel* const inputs;
 
-  QTimer * const watch_timer;
+  HubWatch * const watch;
+  PeerLink * const peer;
   std::wstring watched_hub;
   HubDialog* const dialog;
-  bool was_connected = true;
+
+  GlobalHotkeys hotkeys;
 
   bool validate_suggestion() const;
 
@@ -285,11 +342,15 @@ public:
 
 private slots:
   void handleRefresh();
+  void handleRefreshed(const DisplayInfoList&);
   void handleNameEdit();
   void handleDeviceSelected(const QModelIndex&);
   void handleInputSelected(const QModelIndex&);
+  void handleCurrentRead(const std::string&, VcpValue);
 
-  void handleDoWatch();
+  void handleWatchRefused();
+  void handleDrive(const QString&);
+  void handlePeerDrove(const QString&);
   void handleEnableWatch(bool);
   void handleOpenHubSelect();
 
@@ -301,15 +362,17 @@ private slots:
 DisplayManager::Data::Data(DisplayManager& _owner)
 : QObject(&_owner) 
 , owner(_owner) 
-, devices(new DeviceModel(&owner))
-, watch_timer(new QTimer(this))
-, dialog(new HubDialog(&owner, watched_hub))
+, worker(new DeviceWorker(this))
+, snapshot(new DeskSnapshot(*worker, this))
+, devices(new DeviceModel(*worker, &owner))
+, inputs(new InputModel(&owner))
+, watch(new HubWatch(*worker, this))
+, peer(new PeerLink(*worker, this))
+, dialog(new HubDialog(&owner, *worker, watched_hub))
+, hotkeys(KeySource::create())
 {
   owner.ui.list_devices->setModel(devices);
-
-QShortcut* const shortcut_toggle = new QShortcut(QKeySequence(Qt::Key_Asterisk + Qt::KeypadModifier, Qt::Key_8 + Qt::KeypadModifier), &owner);
-QShortcut* const shortcut_savea = new QShortcut(QKeySequence(Qt::Key_Asterisk + Qt::KeypadModifier, Qt::Key_1 + Qt::KeypadModifier), &owner);
-QShortcut* const shortcut_saveb = new QShortcut(QKeySequence(Qt::Key_Asterisk + Qt::KeypadModifier, Qt::Key_2 + Qt::KeypadModifier), &owner);
+  owner.ui.list_inputs->setModel(inputs);
 
   bool valid = true;
   valid &= (bool)connect(owner.ui.action_refresh, &QAction::triggered, this, &DisplayManager::Data::handleRefresh);
@@ -317,20 +380,48 @@ QShortcut* const shortcut_saveb = new QShortcut(QKeySequence(Qt::Key_Asterisk +
   valid &= (bool)connect(owner.ui.action_saveb, &QAction::triggered, this, &DisplayManager::Data::handleSaveB);
   valid &= (bool)connect(owner.ui.action_toggle, &QAction::triggered, this, &DisplayManager::Data::handleToggle);
 
-  valid &= (bool)connect(watch_timer, &QTimer::timeout, this, &DisplayManager::Data::handleDoWatch);
+  valid &= (bool)connect(watch, &HubWatch::refused, this, &DisplayManager::Data::handleWatchRefused);
+  valid &= (bool)connect(watch, &HubWatch::transition, peer, &PeerLink::transition);
+  valid &= (bool)connect(peer, &PeerLink::handoffStarted, worker, &DeviceWorker::prewarm);
+  valid &= (bool)connect(peer, &PeerLink::drive, this, &DisplayManager::Data::handleDrive);
+  valid &= (bool)connect(peer, &PeerLink::peerDrove, this, &DisplayManager::Data::handlePeerDrove);
   valid &= (bool)connect(owner.ui.action_watch, &QAction::triggered, this, &DisplayManager::Data::handleEnableWatch);
   valid &= (bool)connect(owner.ui.action_select, &QAction::triggered, this, &DisplayManager::Data::handleOpenHubSelect);
   
   valid &= (bool)connect(owner.ui.input_name, &QLineEdit::editingFinished, this, &DisplayManager::Data::handleNameEdit);
   valid &= (bool)connect(owner.ui.list_devices, &QListView::clicked, this, &DisplayManager::Data::handleDeviceSelected);
   valid &= (bool)connect(owner.ui.list_inputs, &QListView::clicked, this, &DisplayManager::Data::handleInputSelected);
-  valid &= (bool)connect(shortcut_toggle, &QShortcut::activated, this, &DisplayManager::Data::handleToggle);
-  valid &= (bool)connect(shortcut_savea, &QShortcut::activated, this, &DisplayManager::Data::handleSaveA);
-  valid &= (bool)connect(shortcut_saveb, &QShortcut::activated, this, &DisplayManager::Data::handleSaveB);
+
+  valid &= (bool)connect(worker, &DeviceWorker::refreshed, this, &DisplayManager::Data::handleRefreshed);
+  valid &= (bool)connect(worker, &DeviceWorker::currentRead, this, &DisplayManager::Data::handleCurrentRead);
+  // the worker logs how long the switch took, the window only needs the input
+  valid &= (bool)connect(worker, &DeviceWorker::inputConfirmed, this, &DisplayManager::Data::handleCurrentRead);
+
+  // the worker's queue takes commands from any thread, so hotkeys go straight to it
+  hotkeys.bind({ KeyCode::numpad_multiply, KeyCode::numpad_8 }, [this](std::chrono::steady_clock::time_point) { devices->toggle_profile(); });
+  hotkeys.bind({ KeyCode::numpad_multiply, KeyCode::numpad_1 }, [this](std::chrono::steady_clock::time_point) { devices->save_a(); });
+  hotkeys.bind({ KeyCode::numpad_multiply, KeyCode::numpad_2 }, [this](std::chrono::steady_clock::time_point) { devices->save_b(); });
+  hotkeys.hint([this]() { worker->prewarm(); });
+  if (!hotkeys.start()) {
+    // without a global source the chords only work while the window has focus
+    QShortcut* const shortcut_toggle = new QShortcut(QKeySequence(Qt::Key_Asterisk + Qt::KeypadModifier, Qt::Key_8 + Qt::KeypadModifier), &owner);
+    QShortcut* const shortcut_savea = new QShortcut(QKeySequence(Qt::Key_Asterisk + Qt::KeypadModifier, Qt::Key_1 + Qt::KeypadModifier), &owner);
+    QShortcut* const shortcut_saveb = new QShortcut(QKeySequence(Qt::Key_Asterisk + Qt::KeypadModifier, Qt::Key_2 + Qt::KeypadModifier), &owner);
+    valid &= (bool)connect(shortcut_toggle, &QShortcut::activated, this, &DisplayManager::Data::handleToggle);
+    valid &= (bool)connect(shortcut_savea, &QShortcut::activated, this, &DisplayManager::Data::handleSaveA);
+    valid &= (bool)connect(shortcut_saveb, &QShortcut::activated, this, &DisplayManager::Data::handleSaveB);
+  }
   Q_ASSERT(valid);
 
+  // the last session's desk right away, the refresh and reads correct it in the background
+  devices->populate(snapshot->displays());
+  for (auto& input : snapshot->inputs())
+    devices->setCurrent(input.first, input.second);
+  devices->setToggled(snapshot->toggled());
+
   handleRefresh();
-  getConnectedUSB();
+  worker->listHubs();
+  peer->configure();
 }
 
 bool DisplayManager::Data::validate_suggestion() const {
@@ -339,98 +430,81 @@ bool DisplayManager::Data::validate_suggestion() const {
 }
 
 void DisplayManager::Data::handleRefresh() {
-  qDebug() << "Refresh";
-  devices->scan();
+  LOG_DEBUG("Refresh");
+  worker->refresh();
+}
+void DisplayManager::Data::handleRefreshed(const DisplayInfoList& displays) {
+  devices->populate(displays);
+
+  // only reset the input list if the shown display went away or changed its inputs
+  const auto* shown = devices->find(inputs->serial());
+  if (!shown || shown->sources != inputs->sources())
+    inputs->show(shown);
 }
 void DisplayManager::Data::handleNameEdit() {
-  qDebug() << "Name Changed to:" << owner.ui.input_name->text();
+  LOG_DEBUG("Name Changed to: {}", owner.ui.input_name->text().toStdString());
   const auto qidx = owner.ui.list_devices->currentIndex();
-  auto* device = devices->get_device(qidx);
-  device->setName(owner.ui.input_name->text());
+  if(!qidx.isValid())
+    return;
+  devices->setName(qidx, owner.ui.input_name->text());
 }
 void DisplayManager::Data::handleDeviceSelected(const QModelIndex& qidx) {
-  qDebug() << "Device Selected:" << qidx;
-  auto* device = devices->get_device(qidx);
-  owner.ui.list_inputs->setModel(device);
-  owner.ui.input_name->setText(device->getName());
-  owner.ui.list_inputs->setCurrentIndex(device->getCurrent());
+  LOG_DEBUG("Device Selected: {}", qidx.row());
+  const auto& device = devices->get_device(qidx);
+  inputs->show(&device);
+  owner.ui.input_name->setText(device.name);
+
+  // show the last known input right away, the read confirms it
+  owner.ui.list_inputs->setCurrentIndex(inputs->indexOf(devices->current(device.serial)));
+  worker->readCurrent(device.serial);
 }
 void DisplayManager::Data::handleInputSelected(const QModelIndex& qidx) {
-  auto* model = static_cast<InputModel*>(owner.ui.list_inputs->model());
-  const auto& input_name = model->rowName(qidx);
-
-  const double max_time = 5.0;
-
-  model->selectInput(input_name);
-
-  const auto start = std::chrono::high_resolution_clock::now();
-  while(true) {
-    const auto end = std::chrono::high_resolution_clock::now();
-    const auto time = std::chrono::duration<double>(end - start).count();
-    if( model->display().current() == input_name ) {
-      qDebug() << "Input change took" << time << "seconds.";
-      break;
-    }
-    if (time > max_time) {
-      qDebug() << "Input change timing took longer than" << max_time << "seconds.";
-      break;
-    }
-  }
+  worker->selectInput(inputs->serial(), inputs->rowName(qidx));
+}
+void DisplayManager::Data::handleCurrentRead(const std::string& serial, VcpValue input) {
+  devices->setCurrent(serial, input);
+  if(inputs->serial() == serial)
+    owner.ui.list_inputs->setCurrentIndex(inputs->indexOf(input));
 }
 
-void DisplayManager::Data::handleDoWatch() {
-  
-  bool is_connected = isUSBConnected(watched_hub);
-  if( was_connected != is_connected ) {
-    qDebug() << "!!!!!  DIFFERENCE  !!!!!";
-
-    devices->load_profile(is_connected ? QString("profile a") : QString("profile b"));
-    auto* device = static_cast<InputModel*>(owner.ui.list_inputs->model());
-    if(device)
-      owner.ui.list_inputs->setCurrentIndex(device->getCurrent());
-
-    was_connected = is_connected;
-  }
+void DisplayManager::Data::handleWatchRefused() {
+  owner.ui.action_watch->setChecked(false);
+}
+void DisplayManager::Data::handleDrive(const QString& profile) {
+  devices->load_profile(profile);
+}
+void DisplayManager::Data::handlePeerDrove(const QString& /*profile*/) {
+  // nothing was written from here, so the cached inputs have to be read back
+  for(int row = 0; row < devices->rowCount(); ++row)
+    worker->readCurrent(devices->get_device(devices->index(row)).serial);
 }
 void DisplayManager::Data::handleEnableWatch(bool checked) {
-  //verify selected hub exists RIGHT NOW before enabling
-  if(!isUSBConnected(watched_hub)) {
-    qWarning() << "The hub you want to watch isn't currently select it. It must be so when you turn on monitoring.";
-    qWarning() << "Curent Hub:" << watched_hub;
-    owner.ui.action_watch->setChecked(false);
-    return;
-  }
-
   if(checked) {
-    was_connected = true;
-    watch_timer->start(1000);
+    watch->setHub(watched_hub);
+    watch->start();
   }
   else {
-    watch_timer->stop();
+    watch->stop();
   }
 }
 void DisplayManager::Data::handleOpenHubSelect() {
   //show a modal to allow the user to select the watched hub
-  watch_timer->stop();
+  watch->stop();
   owner.ui.action_watch->setChecked(false);
 
   dialog->exec();
 }
 void DisplayManager::Data::handleSaveA() {
-  qDebug() << "Save A";
+  LOG_DEBUG("Save A");
   devices->save_a();
 }
 void DisplayManager::Data::handleSaveB() {
-  qDebug() << "Save B";
+  LOG_DEBUG("Save B");
   devices->save_b();
 }
 void DisplayManager::Data::handleToggle() {
-  qDebug() << "Toggle Profile";
+  LOG_DEBUG("Toggle Profile");
   devices->toggle_profile();
-
-  auto* device = static_cast<InputModel*>(owner.ui.list_inputs->model());
-  if(device)
-    owner.ui.list_inputs->setCurrentIndex(device->getCurrent());
 }
 
 
@@ -0,0 +1,63 @@
+#include "DisplayRegistry.h"
+#include "monitors.h"
+
+namespace {
+  template<typename Map, typename Key>
+  int lookup(const Map& map, const Key& key) {
+    const auto iter = map.find(key);
+    return iter != map.end() ? iter->second : -1;
+  }
+
+  const DisplayRegistry::positions none;
+}
+
+void DisplayRegistry::rebuild(const devices& displays, const std::unordered_map<std::string, std::string>& assigned) {
+  clear();
+  serials.reserve(displays.size());
+  hardware_ids.reserve(displays.size());
+  connectors.reserve(displays.size());
+
+  for (int i = 0; i < (int)displays.size(); ++i) {
+    const auto& display = displays[i];
+    serials.emplace(display.serial(), i);
+    hardware_ids.emplace(display.hardwareId(), i);
+    if (!display.location().connector.empty())
+      connectors.emplace(display.location().connector, i);
+    if (display.location().bus >= 0)
+      buses[display.location().bus].push_back(i);
+
+    const auto group = assigned.find(display.serial());
+    if (group != assigned.end() && !group->second.empty())
+      groups[group->second].push_back(i);
+  }
+}
+
+void DisplayRegistry::clear() {
+  serials.clear();
+  hardware_ids.clear();
+  connectors.clear();
+  buses.clear();
+  groups.clear();
+}
+
+int DisplayRegistry::bySerial(const std::string& serial) const {
+  return lookup(serials, serial);
+}
+
+int DisplayRegistry::byHardwareId(const std::wstring& hardware_id) const {
+  return lookup(hardware_ids, hardware_id);
+}
+
+int DisplayRegistry::byConnector(const std::wstring& connector) const {
+  return lookup(connectors, connector);
+}
+
+const DisplayRegistry::positions& DisplayRegistry::onBus(int bus) const {
+  const auto iter = buses.find(bus);
+  return iter != buses.end() ? iter->second : none;
+}
+
+const DisplayRegistry::positions& DisplayRegistry::inGroup(const std::string& group) const {
+  const auto iter = groups.find(group);
+  return iter != groups.end() ? iter->second : none;
+}
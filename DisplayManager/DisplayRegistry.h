@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DisplayObject;
+using devices = std::vector<DisplayObject>;
+
+// Hashed indices over a DisplayCollection's displays, which stay in one contiguous vector.
+// Every lookup is O(1) so walls of hundreds of displays don't turn enumeration, matching or
+// switching quadratic. Positions are indices into DisplayCollection::get() and are only valid
+// until the next refresh.
+class DisplayRegistry {
+public:
+  using positions = std::vector<int>;
+
+  // re-indexes after a refresh, groups are keyed by serial
+  void rebuild(const devices& displays, const std::unordered_map<std::string, std::string>& groups);
+  void clear();
+
+  // -1 if unknown
+  int bySerial(const std::string& serial) const;
+  int byHardwareId(const std::wstring& hardware_id) const;
+  int byConnector(const std::wstring& connector) const;
+
+  // displays sharing a DDC bus, or belonging to a user defined group (e.g. one video wall)
+  const positions& onBus(int bus) const;
+  const positions& inGroup(const std::string& group) const;
+
+private:
+  std::unordered_map<std::string, int> serials;
+  std::unordered_map<std::wstring, int> hardware_ids;
+  std::unordered_map<std::wstring, int> connectors;
+  std::unordered_map<int, positions> buses;
+  std::unordered_map<std::string, positions> groups;
+};
@@ -0,0 +1,460 @@
+#ifdef _WIN32
+
+#include "Dxva2Backend.h"
+#include "wmi_helpers.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <cwctype>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#define UNICODE 1
+#include <lowlevelmonitorconfigurationapi.h>
+#include <physicalmonitorenumerationapi.h>
+#include <windows.h>
+
+#pragma comment(lib, "Dxva2.lib")
+
+template<typename t, DISPLAYCONFIG_DEVICE_INFO_TYPE e>
+t getDeviceInfo(LUID adapterid, UINT32 id) {
+  t info_struct;
+  info_struct.header.type = e;
+  info_struct.header.size = sizeof(info_struct);
+  info_struct.header.adapterId = adapterid;
+  info_struct.header.id = id;
+  DisplayConfigGetDeviceInfo(&info_struct.header);
+  return info_struct;
+};
+
+std::wstring getSourceName(const DISPLAYCONFIG_PATH_INFO& path) {
+  return getDeviceInfo
+    <DISPLAYCONFIG_SOURCE_DEVICE_NAME, DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME>
+    (path.sourceInfo.adapterId,path.sourceInfo.id)
+    .viewGdiDeviceName;
+}
+
+std::wstring getTargetName(const DISPLAYCONFIG_PATH_INFO& path) {
+  return getDeviceInfo
+    <DISPLAYCONFIG_TARGET_DEVICE_NAME, DISPLAYCONFIG_DEVICE_INFO_GET_TARGET_NAME>
+    (path.targetInfo.adapterId, path.targetInfo.id)
+    .monitorFriendlyDeviceName;
+}
+
+// the physical monitors behind one HMONITOR, more than one in clone mode. shared by the
+// transports of its panels and released once the last of them goes away
+struct ScopedPhysical : NONCOPY {
+  const DWORD count;
+  PHYSICAL_MONITOR * const p;
+  
+
+  ScopedPhysical(const HMONITOR handle)
+  : count([&](){
+      TRACE_SCOPE("ScopedPhysical");
+      DWORD c = 0;
+      if (!GetNumberOfPhysicalMonitorsFromHMONITOR(handle, &c))
+        c = 0;
+      return c;
+    }())
+  , p(count > 0 ? new PHYSICAL_MONITOR[count] : nullptr) 
+  {
+    if(p)
+      GetPhysicalMonitorsFromHMONITOR(handle, count, p);
+  }
+  ~ScopedPhysical() {
+    if(p) {
+      DestroyPhysicalMonitors(count, p);
+      delete[] p;
+    }
+  }
+  
+  PHYSICAL_MONITOR& operator[](int x) const {
+    return p[x];
+  }
+};
+
+std::wstring upper(std::wstring value) {
+  std::transform(value.begin(), value.end(), value.begin(), ::towupper);
+  return value;
+}
+
+// "MONITOR\GSM5B09\{4d36e96e-...}\0003" -> "GSM5B09"
+std::wstring modelOf(const std::wstring& id) {
+  const int start = id.find(L'\\',0) + 1;
+  const int end = id.find(L'\\',start);
+  return id.substr(start, end - start);
+}
+
+// device interface name "\\?\DISPLAY#GSM5B09#5&2b1c0a4&0&UID4353#{e6f07b5f-...}" ->
+// instance "DISPLAY\GSM5B09\5&2B1C0A4&0&UID4353", the same instance WmiMonitorID reports
+std::wstring instanceOf(const std::wstring& interface_name) {
+  const auto prefix = std::wstring(L"\\\\?\\");
+  if (interface_name.compare(0, prefix.size(), prefix) != 0)
+    return std::wstring();
+  auto result = interface_name.substr(prefix.size());
+  const auto guid = result.rfind(L"#{");
+  if (guid != std::wstring::npos)
+    result.erase(guid);
+  std::replace(result.begin(), result.end(), L'#', L'\\');
+  return upper(result);
+}
+
+class Dxva2Transport final : public DisplayTransport {
+public:
+  //  these are all determinable from the initializing HMONITOR alone
+
+  const std::shared_ptr<ScopedPhysical> physicals;
+  const DWORD panel;
+  const std::wstring sourceDeviceName;
+  // unique per panel, even for identical models daisy chained on one port
+  std::wstring instance;
+  std::wstring sub_id;
+
+  // determined by path matching
+  bool path_found = false;
+  std::wstring targetDeviceName;
+
+  // determined by wmi matching
+  bool serial_found = false;
+  std::string serial;
+
+  // split phase requests are made aside, one at a time, on a thread kept for the panel. a thread
+  // (and its shared state) per transaction made every switch allocate
+  enum class Call { none, get, set, stop };
+  std::thread aside;
+  std::mutex aside_lock;
+  std::condition_variable aside_changed;
+  Call call = Call::none;
+  uint8_t call_code = 0;
+  uint32_t call_value = 0;
+  bool call_done = false;
+  Reply call_reply{ false, 0, 0 };
+
+
+  Dxva2Transport(std::shared_ptr<ScopedPhysical> _physicals, DWORD _panel, const std::wstring& _sourceDeviceName)
+  : physicals(std::move(_physicals))
+  , panel(_panel)
+  , sourceDeviceName(_sourceDeviceName)
+  {
+    DISPLAY_DEVICE display;
+    ZeroMemory(&display, sizeof(display));
+    display.cb = sizeof(display); 
+
+    // the monitors attached to a source are listed in the same order as its physical monitors
+    if( !EnumDisplayDevices(sourceDeviceName.c_str(), panel, &display, 0) )
+      throw std::runtime_error("no display device for physical monitor");
+    sub_id = modelOf(display.DeviceID);
+
+    ZeroMemory(&display, sizeof(display));
+    display.cb = sizeof(display); 
+    if( EnumDisplayDevices(sourceDeviceName.c_str(), panel, &display, EDD_GET_DEVICE_INTERFACE_NAME) )
+      instance = instanceOf(display.DeviceID);
+  }
+  ~Dxva2Transport() {
+    if (!aside.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(aside_lock);
+      call = Call::stop;
+    }
+    aside_changed.notify_all();
+    aside.join();
+  }
+
+  HANDLE physical() const {
+    return (*physicals)[panel].hPhysicalMonitor;
+  }
+
+  // the identity the cache remembers, the model alone if the instance couldn't be found
+  const std::wstring& identity() const {
+    return instance.empty() ? sub_id : instance;
+  }
+
+  // "\\.\DISPLAY3" panel 1 -> "\\.\DISPLAY3/1" on bus 3, panels behind one output share its aux channel
+  DisplayLocation location() const {
+    DisplayLocation result;
+    result.connector = sourceDeviceName + L"/" + std::to_wstring(panel);
+    const auto digits = sourceDeviceName.find_last_not_of(L"0123456789") + 1;
+    if (digits < sourceDeviceName.size())
+      result.bus = std::stoi(sourceDeviceName.substr(digits));
+    return result;
+  }
+
+  //getting capabilities is VERY expensive
+  std::string capabilities() override {
+    DWORD cchStringLength = 0;
+    if (!GetCapabilitiesStringLength(physical(), &cchStringLength))
+      return std::string();
+
+    std::string result(cchStringLength, '\0');
+    {
+      TRACE_SCOPE("CapabilitiesRequestAndCapabilitiesReply");
+      if (!CapabilitiesRequestAndCapabilitiesReply(physical(), &result[0], cchStringLength))
+        return std::string();
+    }
+    result.resize(strnlen(result.c_str(), result.size()));
+    return result;
+  }
+
+  Reply getVCP(uint8_t code) override {
+    DWORD current = 0, max = 0;
+    bool ok;
+    {
+      TRACE_SCOPE("GetVCPFeatureAndVCPFeatureReply");
+      ok = GetVCPFeatureAndVCPFeatureReply(physical(), code, NULL, &current, &max);
+    }
+    LOG_DEBUG(ok ? "{} vcp get {x}" : "{} vcp fail {x}", physical(), code);
+    return Reply{ ok, (uint32_t)current, (uint32_t)max };
+  }
+  bool setVCP(uint8_t code, uint32_t value) override {
+    TRACE_SCOPE("SetVCPFeature");
+    return SetVCPFeature(physical(), code, value) != FALSE;
+  }
+
+  // dxva2 only blocks for the whole exchange, so split phase requests make the call aside and
+  // report the usual turnaround, by which the reply is normally in
+  std::chrono::microseconds beginGetVCP(uint8_t code) override {
+    request(Call::get, code, 0);
+    return std::chrono::milliseconds(40);
+  }
+  Reply finishGetVCP(uint8_t code) override {
+    return collect();
+  }
+
+  std::chrono::microseconds beginSetVCP(uint8_t code, uint32_t value) override {
+    request(Call::set, code, value);
+    return std::chrono::milliseconds(50);
+  }
+  bool finishSetVCP(uint8_t code, uint32_t value) override {
+    return collect().ok;
+  }
+
+  void request(Call what, uint8_t code, uint32_t value) {
+    {
+      std::lock_guard<std::mutex> lock(aside_lock);
+      call = what;
+      call_code = code;
+      call_value = value;
+      call_done = false;
+    }
+    aside_changed.notify_all();
+    // started on first use, most panels are never asked this way
+    if (!aside.joinable())
+      aside = std::thread([this]() { runAside(); });
+  }
+
+  Reply collect() {
+    std::unique_lock<std::mutex> lock(aside_lock);
+    aside_changed.wait(lock, [this]() { return call_done; });
+    call = Call::none;
+    return call_reply;
+  }
+
+  void runAside() {
+    TRACE_THREAD("dxva2 aside");
+    std::unique_lock<std::mutex> lock(aside_lock);
+    while (true) {
+      aside_changed.wait(lock, [this]() { return call == Call::stop || (call != Call::none && !call_done); });
+      if (call == Call::stop)
+        return;
+      const auto what = call;
+      const auto code = call_code;
+      const auto value = call_value;
+      lock.unlock();
+      const Reply reply = what == Call::get ? getVCP(code) : Reply{ setVCP(code, value), 0, 0 };
+      lock.lock();
+      call_reply = reply;
+      call_done = true;
+      aside_changed.notify_all();
+    }
+  }
+};
+
+using candidates = std::vector<std::unique_ptr<Dxva2Transport>>;
+
+void addPanels(HMONITOR hMonitor, candidates& result) {
+  MONITORINFOEXW info;
+  info.cbSize = sizeof(info);
+  GetMonitorInfoW(hMonitor, &info);
+  const std::wstring sourceDeviceName(info.szDevice);
+
+  auto physicals = std::make_shared<ScopedPhysical>(hMonitor);
+  for (DWORD i = 0; i < physicals->count; ++i)
+    result.push_back(std::make_unique<Dxva2Transport>(physicals, i, sourceDeviceName));
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     Matching
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
+{
+  candidates* result = reinterpret_cast<candidates*>(dwData);
+  addPanels(hMonitor, *result);
+  return TRUE;
+}
+
+// a source drives one target per panel, in clone mode several
+void determinePaths(candidates& data) {
+  TRACE_SCOPE("determinePaths");
+  UINT32 requiredPaths, requiredModes;
+  GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &requiredPaths, &requiredModes);
+  std::vector<DISPLAYCONFIG_PATH_INFO> paths(requiredPaths);
+  std::vector<DISPLAYCONFIG_MODE_INFO> modes(requiredModes);
+  QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &requiredPaths, paths.data(), &requiredModes, modes.data(), nullptr);
+
+  // source -> its panels still waiting for a target, in panel order
+  std::unordered_map<std::wstring, std::vector<Dxva2Transport*>> waiting;
+  for (auto it = data.rbegin(); it != data.rend(); ++it)
+    waiting[(*it)->sourceDeviceName].push_back(it->get());
+
+  for (auto& p : paths) {
+    const auto source = waiting.find(getSourceName(p));
+    if (source == waiting.end() || source->second.empty())
+      continue;
+
+    auto* d = source->second.back();
+    source->second.pop_back();
+    d->path_found = true;
+    d->targetDeviceName = getTargetName(p);
+  }
+
+  for(auto& d : data) {
+    if( !d->path_found )
+      throw std::runtime_error("no display path for physical monitor");
+  }
+}
+
+void determineWMI(candidates& data) {
+  TRACE_SCOPE("determineWMI");
+  HRESULT hres;
+
+  try {
+    ServiceWrapper helper(L"\\\\.\\root\\wmi", hres);
+
+    auto query = helper.query(L"WQL",L"SELECT * FROM WmiMonitorID", hres);
+
+    if (FAILED(hres)) throw WMIH_Exception("Query failed.");
+
+    std::unordered_map<std::wstring, Dxva2Transport*> by_instance;
+    std::unordered_map<std::wstring, std::vector<Dxva2Transport*>> by_model;
+    for (auto& d : data) {
+      if (!d->instance.empty())
+        by_instance.emplace(d->instance, d.get());
+      else
+        by_model[d->sub_id].push_back(d.get());
+    }
+
+    ObjectWrapper obj;
+    while (obj = query.Next()) {
+
+      const auto id = obj.getBSTR(L"InstanceName");
+      const auto serial = obj.getCharArray(L"SerialNumberID", 14);
+      if( id.empty() || serial.empty() )
+        throw std::runtime_error("wmi reported a monitor without instance or serial");
+
+      // "DISPLAY\GSM5B09\5&2b1c0a4&0&UID4353_0"
+      auto instance = upper(id);
+      const auto suffix = instance.rfind(L'_');
+      if (suffix != std::wstring::npos)
+        instance.erase(suffix);
+      const auto sub_id = modelOf(id);
+
+      const auto exact = by_instance.find(instance);
+      if (exact != by_instance.end()) {
+        exact->second->serial_found = true;
+        exact->second->serial = serial;
+        continue;
+      }
+
+      // without an interface name, only a model that appears once can be matched
+      const auto model = by_model.find(sub_id);
+      if (model == by_model.end())
+        continue;
+      if (model->second.size() != 1 || model->second.front()->serial_found)
+        throw std::runtime_error("ambiguous wmi match for physical monitor");
+      model->second.front()->serial_found = true;
+      model->second.front()->serial = serial;
+    }
+  }
+  catch (WMIH_Exception& e) {
+    LOG_WARNING("{} Error code = 0x{x} {}", e.what(), (unsigned long)hres, _com_error(hres).ErrorMessage());
+  }
+
+  for(auto& d : data) {
+    if( !d->serial_found )
+      throw std::runtime_error("no wmi serial for physical monitor");
+  }
+}
+
+struct CachedEnumeration {
+  const identityMap& known;
+  std::unordered_set<std::string> wanted;
+  devices& result;
+  bool missing;
+};
+
+BOOL CALLBACK CachedEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
+{
+  auto* state = reinterpret_cast<CachedEnumeration*>(dwData);
+  candidates panels;
+  addPanels(hMonitor, panels);
+
+  for (auto& panel : panels) {
+    const auto known = state->known.find(panel->identity());
+    if (known == state->known.end()) {
+      state->missing = true;
+      return FALSE;
+    }
+
+    if (!state->wanted.erase(known->second))
+      continue;
+
+    const auto identity = panel->identity();
+    const auto location = panel->location();
+    state->result.push_back(DisplayObject(std::move(panel), std::wstring(), known->second, identity, location));
+  }
+
+  return state->wanted.empty() ? FALSE : TRUE;
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     Dxva2Backend
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+void Dxva2Backend::enumerate(devices& result) {
+  candidates found;
+  {
+    TRACE_SCOPE("EnumDisplayMonitors");
+    EnumDisplayMonitors(NULL, NULL, &MonitorEnumProc, reinterpret_cast<LPARAM>(&found));
+  }
+  determinePaths(found);
+  determineWMI(found);
+
+  for (auto& transport : found) {
+    const auto name = transport->targetDeviceName;
+    const auto serial = transport->serial;
+    const auto identity = transport->identity();
+    const auto location = transport->location();
+    result.push_back(DisplayObject(std::move(transport), name, serial, identity, location));
+  }
+}
+
+bool Dxva2Backend::enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) {
+  CachedEnumeration state{ known, { wanted.begin(), wanted.end() }, result, false };
+  EnumDisplayMonitors(NULL, NULL, &CachedEnumProc, reinterpret_cast<LPARAM>(&state));
+  return !state.missing;
+}
+
+#endif
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "DisplayBackend.h"
+
+// windows: HMONITOR enumeration, QueryDisplayConfig for names, WMI for serials and Dxva2 for DDC/CI
+class Dxva2Backend final : public DisplayBackend {
+public:
+  void enumerate(devices& result) override;
+  bool enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) override;
+};
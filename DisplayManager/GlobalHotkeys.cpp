@@ -0,0 +1,402 @@
+#include "GlobalHotkeys.h"
+#include "Trace.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <QDebug>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <string>
+#endif
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  KeyCode numpad(int digit) {
+    return KeyCode(int(KeyCode::numpad_0) + digit);
+  }
+
+#ifdef _WIN32
+  class HookKeySource : public KeySource {
+    // low level hooks get no user pointer, there is only ever one hotkey thread
+    static HookKeySource* active;
+
+    Sink sink;
+    std::atomic<DWORD> thread_id{ 0 };
+    std::atomic<bool> stopping{ false };
+
+    static KeyCode translate(DWORD vk) {
+      if (vk == VK_MULTIPLY)
+        return KeyCode::numpad_multiply;
+      if (vk >= VK_NUMPAD0 && vk <= VK_NUMPAD9)
+        return numpad(int(vk - VK_NUMPAD0));
+      return KeyCode::other;
+    }
+
+    // windows drops hooks that take too long, this only matches and posts
+    static LRESULT CALLBACK hook(int code, WPARAM wparam, LPARAM lparam) {
+      if (code == HC_ACTION && active) {
+        const auto* info = reinterpret_cast<const KBDLLHOOKSTRUCT*>(lparam);
+        const bool down = wparam == WM_KEYDOWN || wparam == WM_SYSKEYDOWN;
+        active->sink(KeyEvent{ translate(info->vkCode), down, Clock::now() });
+      }
+      return CallNextHookEx(NULL, code, wparam, lparam);
+    }
+
+  public:
+    bool open() override {
+      return true;
+    }
+
+    void run(const Sink& _sink) override {
+      sink = _sink;
+      active = this;
+
+      // make sure the thread has a queue before stop() can post to it
+      MSG msg;
+      PeekMessageW(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+      thread_id = GetCurrentThreadId();
+
+      HHOOK handle = SetWindowsHookExW(WH_KEYBOARD_LL, &HookKeySource::hook, GetModuleHandleW(NULL), 0);
+      if (!handle) {
+        qWarning() << "Could not install keyboard hook" << GetLastError();
+      }
+      else {
+        while (!stopping && GetMessageW(&msg, NULL, 0, 0) > 0) {}
+        UnhookWindowsHookEx(handle);
+      }
+      active = nullptr;
+    }
+
+    void stop() override {
+      stopping = true;
+      const DWORD id = thread_id;
+      if (id)
+        PostThreadMessageW(id, WM_QUIT, 0, 0);
+    }
+  };
+
+  HookKeySource* HookKeySource::active = nullptr;
+#elif defined(__linux__)
+  // keyboards come and go, e.g. whenever the usb switch hands them to the other pc. a device
+  // that reports an error or hangup is dropped, and /dev/input is watched for it to come back
+  class EvdevKeySource : public KeySource {
+    struct Device {
+      int fd;
+      std::string name;
+    };
+
+    std::vector<Device> devices;
+    int watch = -1;
+    int wake[2] = { -1, -1 };
+
+    static KeyCode translate(int code) {
+      switch (code) {
+      case KEY_KPASTERISK: return KeyCode::numpad_multiply;
+      case KEY_KP0: return numpad(0);
+      case KEY_KP1: return numpad(1);
+      case KEY_KP2: return numpad(2);
+      case KEY_KP3: return numpad(3);
+      case KEY_KP4: return numpad(4);
+      case KEY_KP5: return numpad(5);
+      case KEY_KP6: return numpad(6);
+      case KEY_KP7: return numpad(7);
+      case KEY_KP8: return numpad(8);
+      case KEY_KP9: return numpad(9);
+      default: return KeyCode::other;
+      }
+    }
+
+    // keyboards are the devices that report a keypad asterisk
+    static bool hasKeypad(int fd) {
+      unsigned long bits[KEY_MAX / (8 * sizeof(unsigned long)) + 1] = {};
+      if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(bits)), bits) < 0)
+        return false;
+      const size_t width = 8 * sizeof(unsigned long);
+      return (bits[KEY_KPASTERISK / width] >> (KEY_KPASTERISK % width)) & 1;
+    }
+
+    // "event3" if it is a keyboard not open yet, returns whether the node could be opened at all
+    bool add(const std::string& name) {
+      if (name.compare(0, 5, "event") != 0)
+        return false;
+      for (auto& device : devices) {
+        if (device.name == name)
+          return true;
+      }
+      const std::string path = "/dev/input/" + name;
+      const int fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+      if (fd < 0)
+        return false;
+      if (hasKeypad(fd))
+        devices.push_back(Device{ fd, name });
+      else
+        close(fd);
+      return true;
+    }
+
+    // new nodes turn readable once udev has set their permissions, which is an attribute change
+    void added() {
+      alignas(inotify_event) char buffer[4096];
+      ssize_t bytes;
+      while ((bytes = read(watch, buffer, sizeof(buffer))) > 0) {
+        for (char* at = buffer; at < buffer + bytes; ) {
+          const auto* event = reinterpret_cast<const inotify_event*>(at);
+          if (event->len > 0)
+            add(event->name);
+          at += sizeof(inotify_event) + event->len;
+        }
+      }
+    }
+
+  public:
+    ~EvdevKeySource() {
+      for (auto& device : devices)
+        close(device.fd);
+      if (watch >= 0)
+        close(watch);
+      if (wake[0] >= 0) {
+        close(wake[0]);
+        close(wake[1]);
+      }
+    }
+
+    bool open() override {
+      watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (watch < 0 || inotify_add_watch(watch, "/dev/input", IN_CREATE | IN_ATTRIB) < 0) {
+        qWarning() << "Could not watch /dev/input for keyboards";
+        return false;
+      }
+
+      // a readable node means access is right, even if the keyboard is at the other pc for now
+      bool readable = false;
+      for (int i = 0; i < 64; ++i)
+        readable |= add("event" + std::to_string(i));
+      if (!readable) {
+        qWarning() << "No readable keyboard in /dev/input, is the user in the input group?";
+        return false;
+      }
+      return pipe(wake) == 0;
+    }
+
+    void run(const Sink& sink) override {
+      std::vector<pollfd> polled;
+      while (true) {
+        polled.clear();
+        polled.push_back(pollfd{ wake[0], POLLIN, 0 });
+        polled.push_back(pollfd{ watch, POLLIN, 0 });
+        for (auto& device : devices)
+          polled.push_back(pollfd{ device.fd, POLLIN, 0 });
+
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+          if (errno == EINTR)
+            continue;
+          return;
+        }
+        if (polled[0].revents)
+          return;
+
+        // gone keyboards first, a node they left behind may be reused by the one just added
+        for (size_t i = polled.size(); i-- > 2; ) {
+          const auto revents = polled[i].revents;
+          if (revents & POLLIN) {
+            input_event events[16];
+            const ssize_t bytes = read(polled[i].fd, events, sizeof(events));
+            for (ssize_t j = 0; j < bytes / (ssize_t)sizeof(input_event); ++j) {
+              // value 2 is autorepeat, which counts as another press
+              if (events[j].type == EV_KEY)
+                sink(KeyEvent{ translate(events[j].code), events[j].value != 0, Clock::now() });
+            }
+          }
+          if (revents & (POLLERR | POLLHUP | POLLNVAL)) {
+            close(devices[i - 2].fd);
+            devices.erase(devices.begin() + (i - 2));
+          }
+        }
+        if (polled[1].revents & POLLIN)
+          added();
+      }
+    }
+
+    void stop() override {
+      if (wake[1] >= 0) {
+        const char byte = 0;
+        (void)write(wake[1], &byte, 1);
+      }
+    }
+  };
+#endif
+}
+
+std::unique_ptr<KeySource> KeySource::create() {
+#ifdef _WIN32
+  return std::make_unique<HookKeySource>();
+#elif defined(__linux__)
+  return std::make_unique<EvdevKeySource>();
+#else
+  return nullptr;
+#endif
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     ReplayKeySource
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+class ReplayKeySource::Data {
+public:
+  const std::vector<Step> steps;
+
+  std::mutex lock;
+  std::condition_variable wake;
+  bool stopping = false;
+
+  Data(std::vector<Step> _steps) : steps(std::move(_steps)) {}
+};
+
+ReplayKeySource::~ReplayKeySource() {}
+
+ReplayKeySource::ReplayKeySource(std::vector<Step> steps)
+: data(std::make_unique<Data>(std::move(steps)))
+{}
+
+bool ReplayKeySource::open() {
+  return true;
+}
+
+void ReplayKeySource::run(const Sink& sink) {
+  auto due = Clock::now();
+  for (auto& step : d().steps) {
+    due += step.first;
+    {
+      std::unique_lock<std::mutex> lock(d().lock);
+      if (d().wake.wait_until(lock, due, [this]() { return d().stopping; }))
+        return;
+    }
+    KeyEvent event = step.second;
+    event.time = Clock::now();
+    sink(event);
+  }
+}
+
+void ReplayKeySource::stop() {
+  std::lock_guard<std::mutex> lock(d().lock);
+  d().stopping = true;
+  d().wake.notify_all();
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     GlobalHotkeys
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+class GlobalHotkeys::Data {
+public:
+  // a chord has to be finished within this long of its first key
+  static const Clock::duration chord_timeout;
+
+  struct Binding {
+    std::vector<KeyCode> chord;
+    Action action;
+    // keys of the chord matched so far
+    size_t progress = 0;
+    Clock::time_point started;
+  };
+
+  const std::unique_ptr<KeySource> source;
+  std::vector<Binding> bindings;
+  std::function<void()> hint;
+  std::thread thread;
+
+  Data(std::unique_ptr<KeySource> _source) : source(std::move(_source)) {}
+
+  // only key downs move a chord along, anything unexpected starts it over
+  void feed(const KeyEvent& event) {
+    if (!event.down)
+      return;
+
+    bool started = false;
+    for (auto& binding : bindings) {
+      if (binding.progress > 0 && event.time - binding.started > chord_timeout)
+        binding.progress = 0;
+
+      if (event.key == binding.chord[binding.progress]) {
+        if (binding.progress == 0) {
+          binding.started = event.time;
+          started = true;
+        }
+        if (++binding.progress < binding.chord.size())
+          continue;
+        binding.progress = 0;
+        TRACE_SCOPE("hotkey");
+        binding.action(event.time);
+      }
+      else if (event.key == binding.chord[0]) {
+        binding.progress = 1;
+        binding.started = event.time;
+        started = true;
+      }
+      else {
+        binding.progress = 0;
+      }
+    }
+
+    if (started && hint)
+      hint();
+  }
+};
+
+const Clock::duration GlobalHotkeys::Data::chord_timeout = std::chrono::seconds(1);
+
+GlobalHotkeys::~GlobalHotkeys() {
+  stop();
+}
+
+GlobalHotkeys::GlobalHotkeys(std::unique_ptr<KeySource> source)
+: data(std::make_unique<Data>(std::move(source)))
+{}
+
+void GlobalHotkeys::bind(const std::vector<KeyCode>& chord, Action action) {
+  if (chord.empty())
+    return;
+  Data::Binding binding;
+  binding.chord = chord;
+  binding.action = std::move(action);
+  d().bindings.push_back(std::move(binding));
+}
+
+void GlobalHotkeys::hint(std::function<void()> action) {
+  d().hint = std::move(action);
+}
+
+bool GlobalHotkeys::start() {
+  if (!d().source || d().thread.joinable() || !d().source->open())
+    return false;
+
+  d().thread = std::thread([this]() {
+    TRACE_THREAD("hotkeys");
+    d().source->run([this](const KeyEvent& event) { d().feed(event); });
+  });
+  return true;
+}
+
+void GlobalHotkeys::stop() {
+  if (!d().thread.joinable())
+    return;
+  d().source->stop();
+  d().thread.join();
+}
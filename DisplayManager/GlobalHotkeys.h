@@ -0,0 +1,86 @@
+#pragma once
+
+#include "common.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// only the keys chords are made of get their own code
+enum class KeyCode : uint8_t {
+  other
+, numpad_multiply
+, numpad_0
+, numpad_1
+, numpad_2
+, numpad_3
+, numpad_4
+, numpad_5
+, numpad_6
+, numpad_7
+, numpad_8
+, numpad_9
+};
+
+struct KeyEvent {
+  KeyCode key;
+  bool down;
+  std::chrono::steady_clock::time_point time;
+};
+
+// where key presses come from, run on the hotkey thread
+class KeySource {
+public:
+  using Sink = std::function<void(const KeyEvent&)>;
+
+  virtual ~KeySource() {}
+
+  // called before the thread starts, false if no keyboard can be read
+  virtual bool open() = 0;
+  // delivers events until stop() or the source runs dry
+  virtual void run(const Sink& sink) = 0;
+  // may be called from any thread
+  virtual void stop() = 0;
+
+  // a low level keyboard hook on windows, evdev on linux, null elsewhere
+  static std::unique_ptr<KeySource> create();
+};
+
+// plays back a recorded sequence with its original spacing, for benchmarks and debugging
+class ReplayKeySource : public KeySource {
+  PIMPL
+
+public:
+  // each event is delivered after waiting its offset from the previous one
+  using Step = std::pair<std::chrono::microseconds, KeyEvent>;
+
+  ~ReplayKeySource();
+  explicit ReplayKeySource(std::vector<Step> steps);
+
+  bool open() override;
+  void run(const Sink& sink) override;
+  void stop() override;
+};
+
+// Watches every keypress regardless of which window has focus, and fires an action when a
+// bound chord is typed (each key pressed in order, within a second). Actions run directly on
+// the hotkey thread, so they should only post work elsewhere.
+class GlobalHotkeys : NONCOPY {
+  PIMPL
+
+public:
+  // gets the time the chord's last key went down
+  using Action = std::function<void(std::chrono::steady_clock::time_point)>;
+
+  ~GlobalHotkeys();
+  explicit GlobalHotkeys(std::unique_ptr<KeySource> source);
+
+  void bind(const std::vector<KeyCode>& chord, Action action);
+  // runs whenever a key starts one of the bound chords, a hint that an action may follow
+  void hint(std::function<void()> action);
+
+  // false if there is no source or it can't be opened
+  bool start();
+  void stop();
+};
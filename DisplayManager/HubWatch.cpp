@@ -0,0 +1,103 @@
+#include "HubWatch.h"
+#include "DeviceWorker.h"
+
+#include <QDebug>
+#include <QTimer>
+
+class HubWatch::Data {
+public:
+  HubWatch& owner;
+  DeviceWorker& worker;
+  QTimer * const timer;
+
+  std::wstring hub;
+  bool was_connected = true;
+  bool start_requested = false;
+  bool poll_pending = false;
+
+  Data(HubWatch& _owner, DeviceWorker& _worker)
+  : owner(_owner)
+  , worker(_worker)
+  , timer(new QTimer(&_owner))
+  {}
+
+  void poll() {
+    // never stack polls up behind a slow bus
+    if (poll_pending)
+      return;
+    poll_pending = true;
+    worker.pollHub(hub);
+  }
+
+  void handlePolled(const std::wstring& polled, bool is_connected) {
+    poll_pending = false;
+    if (polled != hub)
+      return;
+
+    if (start_requested) {
+      start_requested = false;
+      if (!is_connected) {
+        qWarning() << "The hub you want to watch isn't currently select it. It must be so when you turn on monitoring.";
+        qWarning() << "Curent Hub:" << hub;
+        emit owner.refused();
+        return;
+      }
+
+      was_connected = true;
+      timer->start(1000);
+      emit owner.started();
+      return;
+    }
+
+    if (!timer->isActive())
+      return;
+
+    if (was_connected != is_connected) {
+      qDebug() << "!!!!!  DIFFERENCE  !!!!!";
+      was_connected = is_connected;
+      emit owner.transition(is_connected);
+    }
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     HubWatch
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+HubWatch::~HubWatch() {}
+
+HubWatch::HubWatch(DeviceWorker& worker, QObject* parent)
+: QObject(parent)
+, data(std::make_unique<Data>(*this, worker))
+{
+  bool valid = true;
+  valid &= (bool)connect(d().timer, &QTimer::timeout, this, [this]() { d().poll(); });
+  valid &= (bool)connect(&worker, &DeviceWorker::hubPolled, this, [this](const std::wstring& hub, bool connected) {
+    d().handlePolled(hub, connected);
+  });
+  Q_ASSERT(valid);
+}
+
+const std::wstring& HubWatch::hub() const {
+  return d().hub;
+}
+
+void HubWatch::setHub(const std::wstring& hub) {
+  d().hub = hub;
+}
+
+bool HubWatch::active() const {
+  return d().timer->isActive();
+}
+
+void HubWatch::start() {
+  d().start_requested = true;
+  d().worker.pollHub(d().hub);
+}
+
+void HubWatch::stop() {
+  d().start_requested = false;
+  d().timer->stop();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+
+#include <QObject>
+#include <string>
+
+class DeviceWorker;
+
+// Polls the watched usb hub through the device worker and reports when it comes or goes.
+// Shared by the window and the headless daemon so both switch profiles the same way.
+class HubWatch : public QObject {
+  Q_OBJECT
+  PIMPL
+
+public:
+  ~HubWatch();
+  HubWatch(DeviceWorker& worker, QObject* parent = Q_NULLPTR);
+
+  const std::wstring& hub() const;
+  void setHub(const std::wstring&);
+
+  bool active() const;
+  //the hub must be connected when watching starts, refused() is emitted otherwise
+  void start();
+  void stop();
+
+signals:
+  void started();
+  void refused();
+  void transition(bool connected);
+};
@@ -0,0 +1,438 @@
+#ifdef __linux__
+
+#include "I2cBackend.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <thread>
+#include <unordered_set>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <QSettings>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  const std::string drm_root = "/sys/class/drm/";
+  const std::string adapter_root = "/sys/bus/i2c/devices/";
+
+  const int ddc_address = 0x37;
+  const int edid_address = 0x50;
+
+  // EDID bytes 8-17: manufacturer, product, serial number, week and year of manufacture
+  const uint8_t identity_offset = 8;
+  const size_t identity_length = 10;
+
+  std::vector<std::string> listDirectory(const std::string& path) {
+    std::vector<std::string> result;
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+      return result;
+    while (dirent* entry = readdir(dir)) {
+      if (entry->d_name[0] != '.')
+        result.push_back(entry->d_name);
+    }
+    closedir(dir);
+    return result;
+  }
+
+  std::string readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  std::string trim(const std::string& text) {
+    const auto start = text.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos)
+      return std::string();
+    return text.substr(start, text.find_last_not_of(" \t\r\n") - start + 1);
+  }
+
+  // "i2c-5" -> 5, -1 for anything else
+  int adapterNumber(const std::string& name) {
+    if (name.compare(0, 4, "i2c-") != 0 || name.size() == 4)
+      return -1;
+    for (size_t i = 4; i < name.size(); ++i) {
+      if (name[i] < '0' || name[i] > '9')
+        return -1;
+    }
+    return std::stoi(name.substr(4));
+  }
+
+  struct Edid {
+    std::string model;       // "GSM5B09", as windows reports it
+    std::wstring name;
+    std::string serial;
+    std::string identity;    // the identity_length bytes at identity_offset
+
+    bool parse(const std::string& bytes) {
+      if (bytes.size() < 128)
+        return false;
+      const auto byte = [&](int i) { return (uint8_t)bytes[i]; };
+
+      const uint16_t manufacturer = byte(8) << 8 | byte(9);
+      char text[16];
+      std::snprintf(text, sizeof(text), "%c%c%c%04X"
+        , '@' + ((manufacturer >> 10) & 0x1F), '@' + ((manufacturer >> 5) & 0x1F), '@' + (manufacturer & 0x1F)
+        , byte(10) | byte(11) << 8);
+      model = text;
+      identity = bytes.substr(identity_offset, identity_length);
+
+      // display descriptors, 0xFC holds the name and 0xFF the serial
+      for (int offset = 54; offset < 126; offset += 18) {
+        if (byte(offset) != 0 || byte(offset + 1) != 0)
+          continue;
+        const auto value = trim(bytes.substr(offset + 5, 13));
+        if (byte(offset + 3) == 0xFC)
+          name = std::wstring(value.begin(), value.end());
+        else if (byte(offset + 3) == 0xFF)
+          serial = value;
+      }
+      if (serial.empty()) {
+        const uint32_t number = byte(12) | byte(13) << 8 | byte(14) << 16 | byte(15) << 24;
+        if (number != 0)
+          serial = std::to_string(number);
+      }
+      return true;
+    }
+  };
+
+  // an open /dev/i2c-N
+  class Adapter : NONCOPY {
+    int fd;
+    int address = -1;
+
+    bool select(int _address) {
+      if (address == _address)
+        return true;
+      if (ioctl(fd, I2C_SLAVE, _address) < 0)
+        return false;
+      address = _address;
+      return true;
+    }
+
+  public:
+    explicit Adapter(int bus)
+    : fd(open(("/dev/i2c-" + std::to_string(bus)).c_str(), O_RDWR))
+    {}
+    ~Adapter() {
+      if (fd >= 0)
+        close(fd);
+    }
+
+    bool good() const {
+      return fd >= 0;
+    }
+
+    bool write(int _address, const uint8_t* bytes, size_t size) {
+      return fd >= 0 && select(_address) && ::write(fd, bytes, size) == (ssize_t)size;
+    }
+    bool read(int _address, uint8_t* bytes, size_t size) {
+      return fd >= 0 && select(_address) && ::read(fd, bytes, size) == (ssize_t)size;
+    }
+  };
+
+  // a single read of the EDID bytes that tell displays apart, empty if nothing answered
+  std::string identityOn(int bus) {
+    Adapter adapter(bus);
+    uint8_t buffer[identity_length];
+    if (!adapter.write(edid_address, &identity_offset, 1) || !adapter.read(edid_address, buffer, sizeof(buffer)))
+      return std::string();
+    return std::string(reinterpret_cast<const char*>(buffer), sizeof(buffer));
+  }
+
+  // the adapter the driver links to a connector: "ddc" on most outputs, an "i2c-N" child
+  // (the DisplayPort aux channel) on others
+  int linkedAdapter(const std::string& connector) {
+    char target[256];
+    const auto length = readlink((drm_root + connector + "/ddc").c_str(), target, sizeof(target) - 1);
+    if (length > 0) {
+      const std::string path(target, length);
+      return adapterNumber(path.substr(path.rfind('/') + 1));
+    }
+    for (auto& entry : listDirectory(drm_root + connector)) {
+      const int bus = adapterNumber(entry);
+      if (bus >= 0)
+        return bus;
+    }
+    return -1;
+  }
+
+  // only display adapters are probed, poking SMBus or sensor busses can upset what's on them
+  bool probeable(int bus) {
+    const auto name = trim(readFile(adapter_root + "i2c-" + std::to_string(bus) + "/name"));
+    return name.find("SMBus") == std::string::npos && name.find("smbus") == std::string::npos;
+  }
+
+  struct Connector {
+    std::string name;        // "card0-DP-1"
+    Edid edid;
+    int bus = -1;
+
+    QString key() const {
+      return QString::fromStdString(name + ":" + edid.model + ":" + edid.serial);
+    }
+  };
+
+  // every connected output with an EDID, from sysfs alone
+  std::vector<Connector> findConnectors() {
+    TRACE_SCOPE("findConnectors");
+    std::vector<Connector> result;
+    for (auto& entry : listDirectory(drm_root)) {
+      if (entry.compare(0, 4, "card") != 0 || entry.find('-') == std::string::npos)
+        continue;
+      if (trim(readFile(drm_root + entry + "/status")) != "connected")
+        continue;
+
+      Connector connector;
+      connector.name = entry;
+      if (connector.edid.parse(readFile(drm_root + entry + "/edid")))
+        result.push_back(std::move(connector));
+    }
+    return result;
+  }
+
+  // sysfs links first, then remembered adapters, then probing what's left
+  void resolveBuses(std::vector<Connector>& connectors) {
+    TRACE_SCOPE("resolveBuses");
+    QSettings settings;
+    settings.beginGroup("i2c");
+
+    std::unordered_set<int> claimed;
+    for (auto& connector : connectors) {
+      connector.bus = linkedAdapter(connector.name);
+      if (connector.bus >= 0)
+        claimed.insert(connector.bus);
+    }
+
+    std::vector<Connector*> unresolved;
+    for (auto& connector : connectors) {
+      if (connector.bus >= 0)
+        continue;
+      const int cached = settings.value(connector.key(), -1).toInt();
+      if (cached >= 0 && !claimed.count(cached) && identityOn(cached) == connector.edid.identity) {
+        connector.bus = cached;
+        claimed.insert(cached);
+      }
+      else {
+        unresolved.push_back(&connector);
+      }
+    }
+
+    if (!unresolved.empty()) {
+      TRACE_SCOPE("probe");
+      for (auto& entry : listDirectory("/dev")) {
+        const int bus = adapterNumber(entry);
+        if (bus < 0 || claimed.count(bus) || !probeable(bus))
+          continue;
+        const auto identity = identityOn(bus);
+        if (identity.empty())
+          continue;
+        for (auto* connector : unresolved) {
+          if (connector->bus < 0 && connector->edid.identity == identity) {
+            connector->bus = bus;
+            claimed.insert(bus);
+            break;
+          }
+        }
+      }
+    }
+
+    for (auto& connector : connectors) {
+      if (connector.bus >= 0 && settings.value(connector.key(), -1).toInt() != connector.bus)
+        settings.setValue(connector.key(), connector.bus);
+    }
+    settings.endGroup();
+  }
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     I2cTransport
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+// DDC/CI framing: requests are source 0x51, 0x80 | length, payload, checksum, replies the same
+// from 0x6E. checksums xor every byte including the destination address, 0x6E going out and
+// the 0x50 virtual host address coming back
+class I2cTransport final : public DisplayTransport {
+  Adapter adapter;
+  Clock::time_point ready;
+  // whether the last split phase write went out
+  bool sent = false;
+
+  // displays need a breather between a reply and the next request
+  void pace() {
+    const auto now = Clock::now();
+    if (now < ready)
+      std::this_thread::sleep_until(ready);
+  }
+
+  bool request(std::initializer_list<uint8_t> payload, std::chrono::milliseconds reply_delay) {
+    pace();
+    uint8_t message[16];
+    size_t size = 0;
+    message[size++] = 0x51;
+    message[size++] = uint8_t(0x80 | payload.size());
+    for (auto byte : payload)
+      message[size++] = byte;
+    uint8_t checksum = 0x6E;
+    for (size_t i = 0; i < size; ++i)
+      checksum ^= message[i];
+    message[size++] = checksum;
+
+    const bool ok = adapter.write(ddc_address, message, size);
+    ready = Clock::now() + reply_delay;
+    return ok;
+  }
+
+  // the payload of the reply, false if nothing or garbage came back
+  bool reply(uint8_t* payload, size_t capacity, size_t& length) {
+    pace();
+    uint8_t message[40];
+    const size_t size = std::min(sizeof(message), capacity + 3);
+    const bool ok = adapter.read(ddc_address, message, size);
+    ready = Clock::now() + std::chrono::milliseconds(50);
+    if (!ok || message[0] != 0x6E || !(message[1] & 0x80))
+      return false;
+
+    length = message[1] & 0x7F;
+    if (length == 0 || length > capacity)
+      return false;
+    uint8_t checksum = 0x50;
+    for (size_t i = 0; i < length + 2; ++i)
+      checksum ^= message[i];
+    if (checksum != message[length + 2])
+      return false;
+
+    std::copy(message + 2, message + 2 + length, payload);
+    return true;
+  }
+
+public:
+  explicit I2cTransport(int bus)
+  : adapter(bus)
+  {}
+
+  std::string capabilities() override {
+    const int retries = 3;
+
+    std::string result, fragment;
+    int attempt = 0;
+    while (true) {
+      if (!capabilitiesFragment((uint16_t)result.size(), fragment)) {
+        if (++attempt > retries)
+          return std::string();
+        continue;
+      }
+      attempt = 0;
+      if (fragment.empty())
+        return result;
+      result += fragment;
+    }
+  }
+
+  bool capabilitiesFragment(uint16_t offset, std::string& fragment) override {
+    TRACE_SCOPE("capabilitiesFragment");
+    if (!request({ 0xF3, uint8_t(offset >> 8), uint8_t(offset & 0xFF) }, std::chrono::milliseconds(50)))
+      return false;
+
+    uint8_t payload[35];
+    size_t length;
+    if (!reply(payload, sizeof(payload), length) || length < 3 || payload[0] != 0xE3)
+      return false;
+    if ((payload[1] << 8 | payload[2]) != offset)
+      return false;
+    fragment.assign(reinterpret_cast<const char*>(payload + 3), length - 3);
+    return true;
+  }
+
+  Reply getVCP(uint8_t code) override {
+    TRACE_SCOPE("getVCP");
+    beginGetVCP(code);
+    return finishGetVCP(code);
+  }
+
+  bool setVCP(uint8_t code, uint32_t value) override {
+    TRACE_SCOPE("setVCP");
+    beginSetVCP(code, value);
+    return finishSetVCP(code, value);
+  }
+
+  std::chrono::microseconds beginGetVCP(uint8_t code) override {
+    sent = request({ 0x01, code }, std::chrono::milliseconds(40));
+    return busyFor();
+  }
+
+  Reply finishGetVCP(uint8_t code) override {
+    if (!sent)
+      return Reply{ false, 0, 0 };
+
+    uint8_t payload[8];
+    size_t length;
+    if (!reply(payload, sizeof(payload), length) || length != 8 || payload[0] != 0x02 || payload[1] != 0 || payload[2] != code)
+      return Reply{ false, 0, 0 };
+    return Reply{ true, uint32_t(payload[6] << 8 | payload[7]), uint32_t(payload[4] << 8 | payload[5]) };
+  }
+
+  std::chrono::microseconds beginSetVCP(uint8_t code, uint32_t value) override {
+    sent = request({ 0x03, code, uint8_t(value >> 8), uint8_t(value & 0xFF) }, std::chrono::milliseconds(50));
+    return busyFor();
+  }
+
+  bool finishSetVCP(uint8_t /*code*/, uint32_t /*value*/) override {
+    return sent;
+  }
+
+  std::chrono::microseconds busyFor() override {
+    const auto now = Clock::now();
+    return ready > now ? std::chrono::duration_cast<std::chrono::microseconds>(ready - now) : std::chrono::microseconds(0);
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     I2cBackend
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+void I2cBackend::enumerate(devices& result) {
+  auto connectors = findConnectors();
+  resolveBuses(connectors);
+
+  for (auto& connector : connectors) {
+    if (connector.bus < 0)
+      continue;
+
+    DisplayLocation location;
+    location.connector = std::wstring(connector.name.begin(), connector.name.end());
+    location.bus = connector.bus;
+    // the serial is what profiles are keyed by, fall back to something stable without one
+    const auto serial = connector.edid.serial.empty() ? connector.edid.model + "@" + connector.name : connector.edid.serial;
+    result.push_back(DisplayObject(std::make_unique<I2cTransport>(connector.bus), connector.edid.name, serial, location.connector, location));
+  }
+}
+
+// sysfs hands out identities without touching a bus, so there's no slow step to skip
+bool I2cBackend::enumerateCached(devices& result, const identityMap& /*known*/, const std::vector<std::string>& wanted) {
+  const std::unordered_set<std::string> keep(wanted.begin(), wanted.end());
+  devices all;
+  enumerate(all);
+  for (auto& display : all) {
+    if (keep.count(display.serial()))
+      result.push_back(std::move(display));
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "DisplayBackend.h"
+
+// linux: DRM connectors from sysfs for identities, DDC/CI over /dev/i2c-N.
+// the adapter carrying a connector's DDC lines comes from its sysfs links when the driver
+// provides them, otherwise from probing adapters for a matching EDID. Every mapping is
+// remembered per display and connector, and a remembered adapter is checked with a single
+// EDID header read instead of probing again
+class I2cBackend final : public DisplayBackend {
+public:
+  void enumerate(devices& result) override;
+  bool enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) override;
+};
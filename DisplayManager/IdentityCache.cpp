@@ -0,0 +1,41 @@
+#include "IdentityCache.h"
+
+#include <QSettings>
+
+// an array rather than one key per display, hardware ids like "DISPLAY\GSM5B09\5&2B1C0A4&0&UID4353"
+// hold backslashes, which QSettings would take for nested groups
+identityMap loadIdentities() {
+  identityMap result;
+
+  QSettings settings;
+  const int size = settings.beginReadArray("identities");
+  for (int i = 0; i < size; ++i) {
+    settings.setArrayIndex(i);
+    const auto hardware_id = settings.value("hardware_id").toString();
+    const auto serial = settings.value("serial").toString();
+    if (!hardware_id.isEmpty() && !serial.isEmpty())
+      result.emplace(hardware_id.toStdWString(), serial.toStdString());
+  }
+  settings.endArray();
+
+  return result;
+}
+
+// replaces what was stored, so displays that went away are dropped with it. a refresh that
+// found nothing, e.g. with every monitor off, keeps the last list
+void storeIdentities(const DisplayCollection& collection) {
+  const auto identities = collection.identities();
+  if (identities.empty())
+    return;
+
+  QSettings settings;
+  settings.remove("identities");
+  settings.beginWriteArray("identities");
+  int i = 0;
+  for (auto& pair : identities) {
+    settings.setArrayIndex(i++);
+    settings.setValue("hardware_id", QString::fromStdWString(pair.first));
+    settings.setValue("serial", QString::fromStdString(pair.second));
+  }
+  settings.endArray();
+}
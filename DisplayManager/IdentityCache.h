@@ -0,0 +1,7 @@
+#pragma once
+
+#include "monitors.h"
+
+// serials resolved by the last full refresh, so later runs can skip the wmi lookup
+identityMap loadIdentities();
+void storeIdentities(const DisplayCollection&);
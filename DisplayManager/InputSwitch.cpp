@@ -0,0 +1,145 @@
+#include "InputSwitch.h"
+#include "DdcEngine.h"
+#include "Log.h"
+
+class InputSwitch::Data : public DdcEngine::Listener {
+public:
+  using Clock = DdcEngine::Clock;
+
+  struct Switch {
+    const DisplayObject* display;
+    VcpValue wanted;
+    // the read in flight follows a write the panel took
+    bool written;
+    SwitchResult* result;
+  };
+
+  DisplayHealth& health;
+  DdcEngine engine;
+  milliseconds deadline{ 5000 };
+  milliseconds operation{ 2000 };
+
+  // reused from switch to switch, along with the engine's queues
+  std::vector<Switch> switches;
+  SwitchResultList results;
+
+  // the switch in progress
+  Clock::time_point start;
+  Clock::time_point give_up;
+
+  Data(DisplayHealth& _health)
+  : health(_health)
+  , engine(*this)
+  {}
+
+  void poll(Switch& target, bool written) {
+    target.written = written;
+    engine.read(*target.display, VcpCode::input_source, &target);
+  }
+
+  // a write the panel didn't take is tried again after another look
+  void write(Switch& target) {
+    engine.write(*target.display, VcpCode::input_source, target.wanted.value(), &target);
+  }
+
+  void readDone(void* context, bool ok, uint32_t current, uint32_t) override {
+    auto& target = *static_cast<Switch*>(context);
+    auto& result = *target.result;
+    const auto now = Clock::now();
+    result.seconds = std::chrono::duration<double>(now - start).count();
+    if (ok) {
+      health.succeeded(*target.display);
+      result.input = VcpValue(uint16_t(current));
+    }
+    else if (!target.written) {
+      // a panel that took the write misses reads until it has resynced, that isn't failing
+      health.failed(*target.display);
+      if (health.quarantined(*target.display)) {
+        result.outcome = SwitchResult::unreachable;
+        return;
+      }
+    }
+    if (ok && result.input == target.wanted) {
+      result.outcome = SwitchResult::confirmed;
+      return;
+    }
+    if (now > give_up) {
+      LOG_INFO("Input change timing took longer than {} seconds.", std::chrono::duration<double>(deadline).count());
+      return;
+    }
+    if (target.written) {
+      poll(target, true);
+      return;
+    }
+    LOG_INFO("Input Changed to: {x}", target.wanted.value());
+    write(target);
+  }
+
+  void writeDone(void* context, bool ok) override {
+    auto& target = *static_cast<Switch*>(context);
+    if (!ok)
+      health.failed(*target.display);
+    if (health.quarantined(*target.display))
+      target.result->outcome = SwitchResult::unreachable;
+    else
+      poll(target, ok);
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     InputSwitch
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+InputSwitch::~InputSwitch() {}
+
+InputSwitch::InputSwitch(DisplayHealth& health)
+: data(std::make_unique<Data>(health))
+{}
+
+void InputSwitch::configure(milliseconds deadline, milliseconds operation) {
+  d().deadline = deadline;
+  d().operation = operation;
+  d().engine.setOperationTimeout(operation);
+}
+
+void InputSwitch::reset() {
+  d().engine.reset();
+}
+
+const SwitchResultList& InputSwitch::run(const std::vector<Target>& targets, bool check_first) {
+  // sized before anything points into them
+  auto& results = d().results;
+  auto& switches = d().switches;
+  results.resize(targets.size());
+  switches.clear();
+  for (size_t i = 0; i < targets.size(); ++i) {
+    auto& result = results[i];
+    // assigned over the last switch's serial, keeping its storage
+    result.serial = targets[i].first->serial();
+    result.input = VcpValue();
+    result.outcome = SwitchResult::unconfirmed;
+    result.seconds = 0;
+    switches.push_back(Data::Switch{ targets[i].first, targets[i].second, false, &result });
+  }
+
+  d().start = Data::Clock::now();
+  d().give_up = d().start + d().deadline;
+  for (auto& target : switches) {
+    if (d().health.quarantined(*target.display))
+      target.result->outcome = SwitchResult::quarantined;
+    else if (check_first)
+      d().poll(target, false);
+    else
+      d().write(target);
+  }
+  // whatever was already sent at the deadline gets one operation's time to come back
+  d().engine.run(d().give_up + d().operation);
+
+  for (auto& result : results) {
+    if (result.outcome == SwitchResult::unconfirmed && !result.input.valid())
+      result.outcome = SwitchResult::unreachable;
+  }
+  return results;
+}
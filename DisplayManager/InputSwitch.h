@@ -0,0 +1,56 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+#include "DisplayHealth.h"
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+// how one display fared in a switch
+struct SwitchResult {
+  enum Outcome {
+    confirmed,      // reported the wanted input
+    unconfirmed,    // answered, but not with the wanted input by the deadline
+    unreachable,    // never answered, or stopped and was quarantined
+    quarantined,    // left out, it had stopped answering before
+  };
+
+  std::string serial;
+  // the input last read, not valid if none was
+  VcpValue input;
+  Outcome outcome;
+  double seconds;
+};
+
+using SwitchResultList = std::vector<SwitchResult>;
+
+// Switches many displays at once. Each display's input is read (if check_first), written if it
+// differs, then polled until the panel reports it, with one DdcEngine interleaving all of them
+// around the panels' delays. Quarantined displays are left alone, a display that trips its
+// breaker on the way is dropped, and nothing is waited on past the deadline. Reads that miss
+// while a panel resyncs after taking the write don't count against its health.
+//
+// Everything a switch needs is kept from one to the next, so once the same displays have been
+// switched a couple of times it allocates nothing. Used from one thread at a time, the device
+// worker's or --apply's.
+class InputSwitch : NONCOPY {
+  PIMPL
+
+public:
+  using milliseconds = std::chrono::milliseconds;
+  using Target = std::pair<const DisplayObject*, VcpValue>;
+
+  ~InputSwitch();
+  InputSwitch(DisplayHealth& health);
+
+  // no switch waits on its displays longer than deadline, no single transaction longer than operation
+  void configure(milliseconds deadline, milliseconds operation);
+  // the displays were re-enumerated, forget their buses
+  void reset();
+
+  // in the order of targets, valid until the next run
+  const SwitchResultList& run(const std::vector<Target>& targets, bool check_first);
+};
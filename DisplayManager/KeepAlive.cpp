@@ -0,0 +1,112 @@
+#include "KeepAlive.h"
+#include "Log.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+class KeepAlive::Data {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // anything used this recently is assumed to still be awake
+  static const Clock::duration awake;
+
+  milliseconds interval{ 0 };
+  int budget = 30;
+
+  // token bucket refilled at budget per minute
+  double tokens = 30;
+  Clock::time_point refilled = Clock::now();
+
+  bool prewarming = false;
+
+  void refill(Clock::time_point now) {
+    const double minutes = std::chrono::duration<double, std::ratio<60>>(now - refilled).count();
+    tokens = std::min(double(budget), tokens + minutes * budget);
+    refilled = now;
+  }
+
+  bool ping(const DisplayObject& device, DisplayHealth& health) {
+    if (tokens < 1)
+      return false;
+    tokens -= 1;
+
+    TRACE_DISPLAY_SCOPE("keepalive", device.traceTrack());
+    bool ok = false;
+    try {
+      ok = device.current().valid();
+    }
+    catch (std::exception& e) {
+      LOG_WARNING("Keep alive failed on {} {}", device.serial(), e.what());
+    }
+    if (ok)
+      health.succeeded(device);
+    else
+      health.failed(device);
+    return true;
+  }
+};
+
+const KeepAlive::Data::Clock::duration KeepAlive::Data::awake = std::chrono::seconds(2);
+
+KeepAlive::~KeepAlive() {}
+
+KeepAlive::KeepAlive()
+: data(std::make_unique<Data>())
+{}
+
+void KeepAlive::configure(milliseconds interval, int budget_per_minute) {
+  d().interval = interval;
+  d().budget = std::max(0, budget_per_minute);
+  d().tokens = std::min(d().tokens, double(d().budget));
+}
+
+void KeepAlive::prewarm() {
+  d().prewarming = true;
+}
+
+KeepAlive::milliseconds KeepAlive::step(const devices& displays, DisplayHealth& health) {
+  const auto now = Data::Clock::now();
+  d().refill(now);
+
+  if (d().prewarming) {
+    d().prewarming = false;
+
+    // the longest idle are the most likely to be asleep, they go first if the budget runs short
+    std::vector<const DisplayObject*> idle;
+    for (auto& device : displays) {
+      if (now - device.lastUsed() > Data::awake && !health.quarantined(device))
+        idle.push_back(&device);
+    }
+    std::sort(idle.begin(), idle.end(), [](const DisplayObject* a, const DisplayObject* b) { return a->lastUsed() < b->lastUsed(); });
+    for (auto* device : idle) {
+      if (!d().ping(*device, health))
+        break;
+    }
+  }
+
+  if (d().interval <= milliseconds::zero())
+    return milliseconds::max();
+
+  // one background read per step, so a wake up never holds the worker for long
+  const DisplayObject* oldest = nullptr;
+  for (auto& device : displays) {
+    if (health.quarantined(device))
+      continue;
+    if (!oldest || device.lastUsed() < oldest->lastUsed())
+      oldest = &device;
+  }
+  if (!oldest)
+    return milliseconds::max();
+
+  auto due = oldest->lastUsed() + d().interval;
+  if (due <= now) {
+    if (!d().ping(*oldest, health)) {
+      // out of budget, come back once a token has refilled
+      const auto refill = std::chrono::duration<double, std::ratio<60>>(d().budget > 0 ? 1.0 / d().budget : 1.0);
+      return std::chrono::duration_cast<milliseconds>(refill) + milliseconds(1);
+    }
+    return milliseconds(0);
+  }
+  return std::chrono::duration_cast<milliseconds>(due - now) + milliseconds(1);
+}
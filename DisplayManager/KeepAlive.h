@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+#include "DisplayHealth.h"
+
+#include <chrono>
+
+// Keeps DDC controllers from dozing off, since a monitor that has been idle or in standby
+// can take a second or more to answer its first request. Displays that haven't been talked
+// to for a while get a cheap read, either in the background every interval or all at once
+// when prewarm() is called on the first hint of a switch. Every read comes out of a shared
+// per minute budget so the bus is never kept busy. Quarantined displays are left to
+// DisplayHealth's probes, the others' reads count towards their health. Only called from the
+// device worker thread.
+class KeepAlive : NONCOPY {
+  PIMPL
+
+public:
+  using milliseconds = std::chrono::milliseconds;
+
+  ~KeepAlive();
+  KeepAlive();
+
+  // interval 0 disables the background reads, prewarm() still works
+  void configure(milliseconds interval, int budget_per_minute);
+  // wake every display that may be asleep on the next step
+  void prewarm();
+
+  // reads every display that is due, returns how long until the next one is
+  milliseconds step(const devices& displays, DisplayHealth& health);
+};
@@ -0,0 +1,175 @@
+#include "LevelSync.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+const LevelSync::milliseconds LevelSync::command_interval(50);
+
+class LevelSync::Data {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Ramp {
+    double to = 0;
+    Clock::time_point start;
+    Clock::duration length;
+    int generation = 0;
+
+    double position(double from, Clock::time_point now) const {
+      if (now >= start + length || length <= Clock::duration::zero())
+        return to;
+      const double progress = std::chrono::duration<double>(now - start).count() / std::chrono::duration<double>(length).count();
+      return from + (to - from) * progress;
+    }
+  };
+
+  struct Control {
+    int generation = 0;
+    bool failed = false;
+    uint32_t max = 0;
+    uint32_t written = 0;
+    // where this panel was when the current ramp began
+    double from = 0;
+  };
+
+  struct Display {
+    Clock::time_point ready;
+    std::map<VcpCode, Control> controls;
+  };
+
+  std::map<VcpCode, Ramp> ramps;
+  std::unordered_map<std::string, Display> displays;
+  int generation = 0;
+  bool active = false;
+
+  static uint32_t scaled(double level, uint32_t max) {
+    return uint32_t(level * max + 0.5);
+  }
+
+  static bool settled(const Control& control, const Ramp& ramp, Clock::time_point now) {
+    if (control.generation != ramp.generation)
+      return false;
+    return control.failed || (now >= ramp.start + ramp.length && control.written == scaled(ramp.to, control.max));
+  }
+
+  // one command for this control
+  void advance(const DisplayObject& device, DisplayHealth& health, VcpCode code, Control& control, const Ramp& ramp, Clock::time_point now) {
+    if (control.generation != ramp.generation) {
+      control.generation = ramp.generation;
+      if (control.max == 0) {
+        // learning the range costs this display its slot for now
+        uint32_t current = 0;
+        if (!device.readRange(code, current, control.max)) {
+          health.failed(device);
+          control.failed = true;
+          return;
+        }
+        health.succeeded(device);
+        if (control.max == 0) {
+          control.failed = true;
+          return;
+        }
+        control.written = current;
+        control.from = double(current) / control.max;
+        return;
+      }
+      control.from = double(control.written) / control.max;
+    }
+
+    const uint32_t value = scaled(ramp.position(control.from, now), control.max);
+    if (value == control.written)
+      return;
+    if (!device.write(code, value)) {
+      LOG_WARNING("Could not set level on {}", device.serial());
+      health.failed(device);
+      control.failed = true;
+      return;
+    }
+    health.succeeded(device);
+    control.written = value;
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     LevelSync
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+LevelSync::~LevelSync() {}
+
+LevelSync::LevelSync()
+: data(std::make_unique<Data>())
+{}
+
+void LevelSync::target(VcpCode code, double level, milliseconds ramp) {
+  auto& entry = d().ramps[code];
+  entry.to = std::min(1.0, std::max(0.0, level));
+  entry.start = Data::Clock::now();
+  entry.length = ramp;
+  entry.generation = ++d().generation;
+
+  // a new target clears earlier failures, the display may have come back
+  for (auto& display : d().displays) {
+    auto iter = display.second.controls.find(code);
+    if (iter != display.second.controls.end()) {
+      iter->second.failed = false;
+    }
+  }
+  d().active = true;
+}
+
+void LevelSync::reset() {
+  d().displays.clear();
+}
+
+bool LevelSync::idle() const {
+  return !d().active;
+}
+
+LevelSync::milliseconds LevelSync::step(const devices& displays, DisplayHealth& health) {
+  const auto now = Data::Clock::now();
+  auto next = Data::Clock::time_point::max();
+  bool done = true;
+
+  for (auto& device : displays) {
+    if (health.quarantined(device))
+      continue;
+    auto& display = d().displays[device.serial()];
+    if (display.ready > now) {
+      done = false;
+      next = std::min(next, display.ready);
+      continue;
+    }
+
+    // at most one control per display each round, a busy bus gets the newest value next time
+    for (auto& entry : d().ramps) {
+      auto& control = display.controls[entry.first];
+      if (Data::settled(control, entry.second, now))
+        continue;
+
+      try {
+        d().advance(device, health, entry.first, control, entry.second, now);
+      }
+      catch (std::exception& e) {
+        LOG_WARNING("Could not set level on {} {}", device.serial(), e.what());
+        health.failed(device);
+        control.failed = true;
+      }
+      display.ready = Data::Clock::now() + command_interval;
+      next = std::min(next, display.ready);
+      done = false;
+      break;
+    }
+  }
+
+  if (done) {
+    d().active = false;
+    return milliseconds::max();
+  }
+  // rounded up, waking early would only spin
+  const auto wait = std::chrono::duration_cast<milliseconds>(next - Data::Clock::now() + milliseconds(1) - Data::Clock::duration(1));
+  return std::max(milliseconds(0), wait);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+#include "DisplayHealth.h"
+
+#include <chrono>
+#include <cstdint>
+
+// Keeps brightness (0x10) and contrast (0x12) matched across every display and ramps them
+// towards a target. Targets are fractions of each panel's own maximum, so panels reporting
+// 0-100 and 0-255 end up at the same relative level.
+//
+// Ramps are sampled against the clock each time a display is ready for its next command,
+// so a display that falls behind skips straight to the current position instead of
+// replaying every intermediate step. Only called from the device worker thread.
+class LevelSync : NONCOPY {
+  PIMPL
+
+public:
+  using milliseconds = std::chrono::milliseconds;
+
+  // the DDC/CI spec asks hosts to leave 50ms between commands to one display
+  static const milliseconds command_interval;
+
+  ~LevelSync();
+  LevelSync();
+
+  // level is clamped to 0..1, a zero ramp writes it on the next step
+  void target(VcpCode code, double level, milliseconds ramp);
+  // the displays were re-enumerated, forget their ranges
+  void reset();
+
+  bool idle() const;
+  // writes every display that is due, returns how long until the next one is
+  // quarantined displays are skipped until they recover, the others' commands count towards
+  // their health
+  milliseconds step(const devices& displays, DisplayHealth& health);
+};
@@ -0,0 +1,192 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <QDebug>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  struct Record {
+    int64_t time;
+    const char * format;
+    LogLevel level;
+    uint8_t count;
+    LogArg args[Log::max_args];
+  };
+
+  // single producer (its thread), single consumer (the drainer)
+  struct Ring {
+    static const uint32_t capacity = 512;
+
+    std::array<Record, capacity> records;
+    std::atomic<uint32_t> head{ 0 };
+    std::atomic<uint32_t> tail{ 0 };
+    std::atomic<uint32_t> dropped{ 0 };
+  };
+
+  std::atomic<bool> draining(false);
+  // set by the first record logged since the drainer last looked, so it sleeps while nothing is
+  std::atomic<bool> queued(false);
+  std::mutex waiting;
+  std::condition_variable wake;
+  std::thread drainer;
+  std::mutex registry;
+  std::vector<std::shared_ptr<Ring>> rings;
+
+  thread_local std::shared_ptr<Ring> local;
+
+  Ring& ring() {
+    if (!local) {
+      local = std::make_shared<Ring>();
+      std::lock_guard<std::mutex> lock(registry);
+      rings.push_back(local);
+    }
+    return *local;
+  }
+
+  int64_t now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+  std::string render(const Record& record) {
+    std::string result;
+    int next = 0;
+    for (const char* c = record.format; *c; ++c) {
+      const bool plain = c[0] == '{' && c[1] == '}';
+      const bool hex = c[0] == '{' && c[1] == 'x' && c[2] == '}';
+      if ((plain || hex) && next < record.count) {
+        record.args[next++].format(result, hex);
+        c += plain ? 1 : 2;
+        continue;
+      }
+      result += *c;
+    }
+    return result;
+  }
+
+  void print(LogLevel level, const std::string& line) {
+    switch (level) {
+    case LogLevel::debug: qDebug().noquote() << line.c_str(); break;
+    case LogLevel::info: qInfo().noquote() << line.c_str(); break;
+    case LogLevel::warning: qWarning().noquote() << line.c_str(); break;
+    }
+  }
+
+  // everything queued so far, across threads, in the order it was logged
+  void drain() {
+    std::vector<std::shared_ptr<Ring>> all;
+    {
+      std::lock_guard<std::mutex> lock(registry);
+      all = rings;
+    }
+
+    std::vector<Record> pending;
+    for (auto& r : all) {
+      const uint32_t head = r->head.load(std::memory_order_acquire);
+      uint32_t tail = r->tail.load(std::memory_order_relaxed);
+      for (; tail != head; ++tail)
+        pending.push_back(r->records[tail % Ring::capacity]);
+      r->tail.store(tail, std::memory_order_release);
+
+      const uint32_t dropped = r->dropped.exchange(0);
+      if (dropped > 0) {
+        Record note{ now(), "{} log records dropped, the ring was full", LogLevel::warning, 1, {} };
+        note.args[0] = LogArg(dropped);
+        pending.push_back(note);
+      }
+    }
+
+    std::stable_sort(pending.begin(), pending.end(), [](const Record& a, const Record& b) { return a.time < b.time; });
+    for (auto& record : pending)
+      print(record.level, render(record));
+  }
+
+}
+
+void LogArg::format(std::string& out, bool hex) const {
+  char buffer[32];
+  switch (type) {
+  case Type::none:
+    return;
+  case Type::integer:
+    std::snprintf(buffer, sizeof(buffer), hex ? "%02llX" : "%lld", (long long)integer);
+    break;
+  case Type::unsigned_integer:
+    std::snprintf(buffer, sizeof(buffer), hex ? "%02llX" : "%llu", (unsigned long long)unsigned_integer);
+    break;
+  case Type::real:
+    std::snprintf(buffer, sizeof(buffer), "%g", real);
+    break;
+  case Type::text:
+    out += text;
+    return;
+  }
+  out += buffer;
+}
+
+void Log::push(LogLevel level, const char* format, const LogArg* args, int count) {
+  Record record{ now(), format, level, uint8_t(count), {} };
+  std::copy(args, args + count, record.args);
+
+  if (!draining.load(std::memory_order_acquire)) {
+    print(level, render(record));
+    return;
+  }
+
+  auto& r = ring();
+  const uint32_t head = r.head.load(std::memory_order_relaxed);
+  if (head - r.tail.load(std::memory_order_acquire) >= Ring::capacity) {
+    r.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  r.records[head % Ring::capacity] = record;
+  r.head.store(head + 1, std::memory_order_release);
+
+  // passing through the mutex means the drainer is either still ahead of its check or already
+  // waiting, so the notify can't fall between the two
+  if (!queued.exchange(true, std::memory_order_acq_rel)) {
+    { std::lock_guard<std::mutex> lock(waiting); }
+    wake.notify_one();
+  }
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     LogSession
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+LogSession::LogSession() {
+  draining = true;
+  drainer = std::thread([]() {
+    std::unique_lock<std::mutex> lock(waiting);
+    while (draining) {
+      wake.wait(lock, []() { return queued.load(std::memory_order_acquire) || !draining; });
+      lock.unlock();
+      queued.exchange(false, std::memory_order_acq_rel);
+      drain();
+      lock.lock();
+    }
+  });
+}
+
+LogSession::~LogSession() {
+  {
+    std::lock_guard<std::mutex> lock(waiting);
+    draining = false;
+  }
+  wake.notify_one();
+  drainer.join();
+  // anything logged while the drainer was finishing up
+  drain();
+}
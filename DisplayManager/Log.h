@@ -0,0 +1,102 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstdint>
+#include <string>
+
+// Logging for the device paths. A log call copies its arguments into a fixed size binary record
+// on the calling thread's own ring buffer and returns, with no formatting or console write. Only
+// the first record since the last drain takes a lock, briefly, to wake the background thread that
+// drains every ring, formats the records in time order and hands them to Qt's message handler. A full ring drops records, and says how many, rather than wait.
+//
+// Formats are string literals with a "{}" per argument, "{x}" prints an integer in hex. Levels
+// below DM_LOG_LEVEL are compiled out together with their arguments.
+enum class LogLevel : uint8_t { debug, info, warning };
+
+#ifndef DM_LOG_LEVEL
+#define DM_LOG_LEVEL 1
+#endif
+
+// one argument, copied into the record. text longer than the record holds is cut short
+class LogArg {
+public:
+  enum class Type : uint8_t { none, integer, unsigned_integer, real, text };
+  static const int text_size = 63;
+
+  LogArg() : type(Type::none) {}
+  LogArg(bool value) : type(Type::text) { copy(value ? "true" : "false"); }
+  LogArg(int value) : type(Type::integer) { integer = value; }
+  LogArg(long value) : type(Type::integer) { integer = value; }
+  LogArg(long long value) : type(Type::integer) { integer = value; }
+  LogArg(unsigned value) : type(Type::unsigned_integer) { unsigned_integer = value; }
+  LogArg(unsigned long value) : type(Type::unsigned_integer) { unsigned_integer = value; }
+  LogArg(unsigned long long value) : type(Type::unsigned_integer) { unsigned_integer = value; }
+  LogArg(uint8_t value) : type(Type::unsigned_integer) { unsigned_integer = value; }
+  LogArg(double value) : type(Type::real) { real = value; }
+  LogArg(const void* value) : type(Type::unsigned_integer) { unsigned_integer = (uintptr_t)value; }
+  LogArg(const char* value) : type(Type::text) { copy(value); }
+  LogArg(const std::string& value) : type(Type::text) { copy(value.c_str()); }
+  // narrowed, anything outside ascii becomes '?'
+  LogArg(const wchar_t* value) : type(Type::text) { copy(value); }
+  LogArg(const std::wstring& value) : type(Type::text) { copy(value.c_str()); }
+
+  // appends the value, in hex if asked and it is an integer
+  void format(std::string& out, bool hex) const;
+
+private:
+  Type type;
+  union {
+    int64_t integer;
+    uint64_t unsigned_integer;
+    double real;
+    char text[text_size + 1];
+  };
+
+  template<typename Char>
+  void copy(const Char* value) {
+    int i = 0;
+    for (; value && value[i] && i < text_size; ++i)
+      text[i] = value[i] >= 0 && value[i] < 128 ? char(value[i]) : '?';
+    text[i] = 0;
+  }
+};
+
+class Log {
+public:
+  static const int max_args = 4;
+
+  template<typename... Args>
+  static void write(LogLevel level, const char* format, const Args&... args) {
+    static_assert(sizeof...(Args) <= max_args, "too many log arguments");
+    const LogArg list[max_args + 1] = { LogArg(args)... };
+    push(level, format, list, int(sizeof...(Args)));
+  }
+
+private:
+  static void push(LogLevel, const char* format, const LogArg* args, int count);
+};
+
+// drains the rings on a background thread from construction to the end of main. without a
+// session running, records are formatted and written on the calling thread as they come
+class LogSession : public NONCOPY {
+public:
+  LogSession();
+  ~LogSession();
+};
+
+#if DM_LOG_LEVEL <= 0
+#define LOG_DEBUG(...) Log::write(LogLevel::debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+#if DM_LOG_LEVEL <= 1
+#define LOG_INFO(...) Log::write(LogLevel::info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+#if DM_LOG_LEVEL <= 2
+#define LOG_WARNING(...) Log::write(LogLevel::warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
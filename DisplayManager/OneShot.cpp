@@ -0,0 +1,131 @@
+#include "OneShot.h"
+#include "IdentityCache.h"
+#include "InputSwitch.h"
+#include "monitors.h"
+
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QProcess>
+#include <QSettings>
+
+namespace {
+  double milliseconds(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+  }
+}
+
+int runApply(const QString& profile, bool timing, std::chrono::steady_clock::time_point start) {
+  using clock = std::chrono::steady_clock;
+
+  std::vector<std::pair<std::string, VcpValue>> targets;
+  std::vector<std::string> wanted;
+  std::chrono::milliseconds deadline, operation;
+  {
+    QSettings settings;
+    settings.beginGroup("profiles");
+    if (!settings.childGroups().contains(profile)) {
+      std::cerr << "unknown profile: " << profile.toStdString() << std::endl;
+      return 1;
+    }
+    settings.beginGroup(profile);
+    for (const auto& serial : settings.childKeys()) {
+      const auto value = VcpValue::parse(settings.value(serial).toString().toStdString());
+      if (!value.valid())
+        continue;
+      targets.push_back(std::make_pair(serial.toStdString(), value));
+      wanted.push_back(serial.toStdString());
+    }
+    settings.endGroup();
+    settings.endGroup();
+
+    // the same limits the daemon switches with
+    settings.beginGroup("Health");
+    deadline = std::chrono::milliseconds(settings.value("switch_deadline", 5000).toInt());
+    operation = std::chrono::milliseconds(settings.value("operation_timeout", 2000).toInt());
+    settings.endGroup();
+  }
+  const auto loaded = clock::now();
+
+  // only fall back to the full path and wmi matching when a display isn't in the cache
+  DisplayCollection collection;
+  const bool cached = collection.refreshCached(loadIdentities(), wanted);
+  if (!cached) {
+    collection.refresh();
+    storeIdentities(collection);
+  }
+  const auto enumerated = clock::now();
+
+  int failures = 0;
+  std::vector<InputSwitch::Target> switches;
+  for (auto& target : targets) {
+    const auto device = std::find_if(collection.get().begin(), collection.get().end(), [&](const DisplayObject& display) {
+      return display.serial() == target.first;
+    });
+    if (device == collection.get().end()) {
+      std::cerr << "could not switch " << target.first << ": not connected" << std::endl;
+      ++failures;
+      continue;
+    }
+    switches.push_back(std::make_pair(&*device, target.second));
+  }
+
+  // read first, write only what differs, and give up on a display at the deadline
+  DisplayHealth health;
+  health.reset(collection.get());
+  InputSwitch switcher(health);
+  switcher.configure(deadline, operation);
+  static const char * outcomes[] = { "confirmed", "unconfirmed", "unreachable", "quarantined" };
+  for (auto& result : switcher.run(switches, true)) {
+    if (result.outcome == SwitchResult::confirmed)
+      continue;
+    std::cerr << "could not switch " << result.serial << ": " << outcomes[result.outcome] << std::endl;
+    ++failures;
+  }
+  const auto switched = clock::now();
+
+  if (timing) {
+    std::cout << "startup " << milliseconds(start, loaded) << " ms"
+      << ", enumerate " << milliseconds(loaded, enumerated) << " ms" << (cached ? " (cached)" : " (full)")
+      << ", switch " << milliseconds(enumerated, switched) << " ms"
+      << ", total " << milliseconds(start, switched) << " ms" << std::endl;
+  }
+
+  return failures ? 1 : 0;
+}
+
+int runApplyBenchmark(int runs, const QStringList& profiles) {
+  if (runs <= 0 || profiles.isEmpty()) {
+    std::cerr << "usage: DisplayManager --bench-apply <runs> <profile> [profile...]" << std::endl;
+    return 2;
+  }
+
+  std::vector<double> samples;
+  for (int i = 0; i < runs; ++i) {
+    const auto& profile = profiles[i % profiles.size()];
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QProcess process;
+    process.start(QCoreApplication::applicationFilePath(), QStringList{ "--apply", profile });
+    if (!process.waitForFinished(60000) || process.exitCode() != 0) {
+      std::cerr << "run " << i << " (" << profile.toStdString() << ") failed" << std::endl;
+      return 1;
+    }
+
+    samples.push_back(timer.nsecsElapsed() / 1e6);
+  }
+
+  std::sort(samples.begin(), samples.end());
+  const double mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+  std::cout << "cold start to switch over " << runs << " runs:"
+    << " min " << samples.front() << " ms"
+    << ", median " << samples[samples.size() / 2] << " ms"
+    << ", mean " << mean << " ms"
+    << ", max " << samples.back() << " ms" << std::endl;
+  return 0;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <QStringList>
+#include <chrono>
+
+// applies a saved profile and exits, building no window and never reading capabilities. Switches
+// like the daemon does, within its deadline, and fails unless every display reported the input
+int runApply(const QString& profile, bool timing, std::chrono::steady_clock::time_point start);
+
+// launches "--apply" as a fresh process runs times, cycling through the given profiles,
+// and reports cold start to switch times
+int runApplyBenchmark(int runs, const QStringList& profiles);
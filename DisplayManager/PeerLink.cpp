@@ -0,0 +1,234 @@
+#include "PeerLink.h"
+#include "DeviceWorker.h"
+
+#include <random>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QSettings>
+#include <QTimer>
+#include <QUdpSocket>
+
+namespace {
+  const quint16 default_port = 47123;
+  const int hello_interval = 2000;
+  const int alive_window = 3 * hello_interval;
+  // how long the receiving side waits for the peer's DONE before switching on its own
+  const int handoff_timeout = 3000;
+  // a DONE that arrived before our own usb poll noticed the change is still honored this long
+  const int done_window = 10000;
+
+  // the local address the system routes to the peer from. connecting a udp socket sends
+  // nothing, it only picks the route
+  QHostAddress routeTo(const QHostAddress& peer, quint16 port) {
+    QUdpSocket probe;
+    probe.connectToHost(peer, port);
+    if (!probe.waitForConnected(1000))
+      return QHostAddress();
+    return probe.localAddress();
+  }
+}
+
+class PeerLink::Data {
+public:
+  PeerLink& owner;
+  DeviceWorker& worker;
+
+  QUdpSocket * const socket;
+  QTimer * const hello_timer;
+  QTimer * const fallback_timer;
+
+  bool active = false;
+  QHostAddress peer;
+  quint16 peer_port = default_port;
+  const quint32 id;
+  quint32 sequence = 0;
+
+  QElapsedTimer last_heard;
+  // repeats are dropped by sequence, which only means something for the instance that sent it
+  quint32 peer_id = 0;
+  quint32 last_release = 0;
+  quint32 last_done = 0;
+
+  // giving side
+  bool giving = false;
+  quint32 giving_sequence = 0;
+  QString giving_profile;
+
+  // receiving side
+  bool expecting = false;
+  QString expected_profile;
+  QElapsedTimer done_received;
+
+  Data(PeerLink& _owner, DeviceWorker& _worker)
+  : owner(_owner)
+  , worker(_worker)
+  , socket(new QUdpSocket(&_owner))
+  , hello_timer(new QTimer(&_owner))
+  , fallback_timer(new QTimer(&_owner))
+  , id(std::random_device()())
+  {
+    fallback_timer->setSingleShot(true);
+  }
+
+  void send(const char* type, quint32 seq, int copies = 1) {
+    const QByteArray message = "DM1 " + QByteArray::number(id) + " " + type + " " + QByteArray::number(seq);
+    // udp may drop one, the receiver ignores repeats
+    for (int i = 0; i < copies; ++i)
+      socket->writeDatagram(message, peer, peer_port);
+  }
+
+  bool alive() const {
+    return last_heard.isValid() && last_heard.elapsed() < alive_window;
+  }
+
+  void handleDatagram(const QByteArray& datagram, const QHostAddress& from, quint16 from_port) {
+    // the peer sends from the port it listens on, anyone else on the network is ignored
+    if (from_port != peer_port || !from.isEqual(peer, QHostAddress::TolerantConversion))
+      return;
+    const auto fields = datagram.split(' ');
+    if (fields.size() != 4 || fields[0] != "DM1")
+      return;
+    const quint32 sender = fields[1].toUInt();
+    if (sender == id)
+      return;
+
+    const auto& type = fields[2];
+    const quint32 seq = fields[3].toUInt();
+    last_heard.start();
+
+    // a restarted peer has a new id and counts from 1 again
+    if (sender != peer_id) {
+      peer_id = sender;
+      last_release = 0;
+      last_done = 0;
+    }
+
+    if (type == "RELEASE" && seq != last_release) {
+      last_release = seq;
+      qDebug() << "Peer is handing over the desk";
+      emit owner.handoffStarted();
+      // stage now, our own hub poll may not notice for up to a second
+      fallback_timer->start(handoff_timeout);
+    }
+    else if (type == "DONE" && seq != last_done) {
+      last_done = seq;
+      fallback_timer->stop();
+      if (expecting) {
+        expecting = false;
+        emit owner.peerDrove(expected_profile);
+      }
+      else {
+        done_received.start();
+      }
+    }
+  }
+
+  void handleFallback() {
+    if (!expecting)
+      return;
+    qWarning() << "Peer didn't finish the handoff, switching locally";
+    expecting = false;
+    emit owner.drive(expected_profile);
+  }
+
+  void handleLoaded(const QString& name) {
+    if (!giving || name != giving_profile)
+      return;
+    giving = false;
+    send("DONE", giving_sequence, 2);
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     PeerLink
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+PeerLink::~PeerLink() {}
+
+PeerLink::PeerLink(DeviceWorker& worker, QObject* parent)
+: QObject(parent)
+, data(std::make_unique<Data>(*this, worker))
+{
+  bool valid = true;
+  valid &= (bool)connect(d().socket, &QUdpSocket::readyRead, this, [this]() {
+    while (d().socket->hasPendingDatagrams()) {
+      QByteArray datagram(d().socket->pendingDatagramSize(), 0);
+      QHostAddress from;
+      quint16 from_port = 0;
+      d().socket->readDatagram(datagram.data(), datagram.size(), &from, &from_port);
+      d().handleDatagram(datagram, from, from_port);
+    }
+  });
+  valid &= (bool)connect(d().hello_timer, &QTimer::timeout, this, [this]() { d().send("HELLO", 0); });
+  valid &= (bool)connect(d().fallback_timer, &QTimer::timeout, this, [this]() { d().handleFallback(); });
+  valid &= (bool)connect(&worker, &DeviceWorker::profileLoaded, this, [this](const QString& name) { d().handleLoaded(name); });
+  Q_ASSERT(valid);
+}
+
+bool PeerLink::configure() {
+  QSettings settings;
+  settings.beginGroup("Peer");
+  const auto address = settings.value("address").toString();
+  const auto port = settings.value("port", default_port).toUInt();
+  const auto listen = settings.value("listen", default_port).toUInt();
+  settings.endGroup();
+
+  if (address.isEmpty())
+    return false;
+
+  d().peer = QHostAddress(address);
+  d().peer_port = port;
+  // only on the interface that reaches the peer, not on every network the pc is on
+  const auto local = routeTo(d().peer, d().peer_port);
+  if (local.isNull()) {
+    qWarning() << "No route to peer" << address;
+    return false;
+  }
+  if (!d().socket->bind(local, listen)) {
+    qWarning() << "Could not listen for peer on" << local.toString() << "port" << listen << d().socket->errorString();
+    return false;
+  }
+
+  d().active = true;
+  d().hello_timer->start(hello_interval);
+  d().send("HELLO", 0);
+  return true;
+}
+
+bool PeerLink::peerAlive() const {
+  return d().active && d().alive();
+}
+
+void PeerLink::transition(bool connected) {
+  const QString profile = connected ? QString("profile a") : QString("profile b");
+
+  if (!peerAlive()) {
+    emit drive(profile);
+    return;
+  }
+
+  if (!connected) {
+    d().giving = true;
+    d().giving_sequence = ++d().sequence;
+    d().giving_profile = profile;
+    d().send("RELEASE", d().giving_sequence, 2);
+    emit drive(profile);
+    return;
+  }
+
+  // the peer may already be done by the time our own poll notices
+  if (d().done_received.isValid() && d().done_received.elapsed() < done_window) {
+    d().done_received.invalidate();
+    emit peerDrove(profile);
+    return;
+  }
+
+  d().expecting = true;
+  d().expected_profile = profile;
+  if (!d().fallback_timer->isActive())
+    d().fallback_timer->start(handoff_timeout);
+}
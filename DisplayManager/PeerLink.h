@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common.h"
+
+#include <QObject>
+#include <QString>
+
+class DeviceWorker;
+
+// Coordinates usb triggered handoffs with the DisplayManager on the other pc sharing the desk,
+// so only one of them writes the monitors. Small udp datagrams, works over loopback for testing.
+//
+// The host giving up the desk (its hub disappeared) announces RELEASE, drives the switch itself
+// since it is still on the active input, and announces DONE. The host receiving the desk stages
+// on RELEASE and does not write unless DONE fails to arrive in time. Without a configured or
+// responsive peer every transition drives locally, exactly as before.
+class PeerLink : public QObject {
+  Q_OBJECT
+  PIMPL
+
+public:
+  ~PeerLink();
+  PeerLink(DeviceWorker& worker, QObject* parent = Q_NULLPTR);
+
+  // reads Peer/address, Peer/port and Peer/listen from settings, stays inactive without an address.
+  // listens only on the interface that routes to the peer, and only takes datagrams sent from
+  // the peer's address and port
+  bool configure();
+  bool peerAlive() const;
+
+  // a hub transition seen on this host, drive() is emitted if this host should write the monitors
+  void transition(bool connected);
+
+signals:
+  // the peer is about to hand the desk over, a good time to wake the displays
+  void handoffStarted();
+  void drive(const QString& profile);
+  // the other host finished switching the desk over to us
+  void peerDrove(const QString& profile);
+};
@@ -0,0 +1,102 @@
+#include "SettingsWatch.h"
+#include "Log.h"
+
+#include <string>
+
+#include <QSettings>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+class SettingsWatch::Data {
+public:
+  bool armed = false;
+
+#ifdef _WIN32
+  HKEY key = nullptr;
+  HANDLE event = nullptr;
+
+  ~Data() {
+    if (key)
+      RegCloseKey(key);
+    if (event)
+      CloseHandle(event);
+  }
+
+  // QSettings names its registry location "\HKEY_CURRENT_USER\Software\<organization>\<application>"
+  void open() {
+    const auto prefix = std::wstring(L"\\HKEY_CURRENT_USER\\");
+    auto path = QSettings().fileName().toStdWString();
+    if (path.compare(0, prefix.size(), prefix) == 0)
+      path.erase(0, prefix.size());
+    if (RegCreateKeyExW(HKEY_CURRENT_USER, path.c_str(), 0, nullptr, 0, KEY_NOTIFY, nullptr, &key, nullptr) != ERROR_SUCCESS) {
+      LOG_WARNING("Could not watch the settings, profiles are read on every load");
+      key = nullptr;
+      return;
+    }
+    event = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+  }
+
+  // notifications fire once and are tied to the thread that asked, so this is re-armed on the
+  // checking thread after every change
+  bool arm() {
+    return key && event
+      && RegNotifyChangeKeyValue(key, TRUE, REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET, event, TRUE) == ERROR_SUCCESS;
+  }
+
+  bool check() {
+    if (!key || !event)
+      return true;
+    if (WaitForSingleObject(event, 0) != WAIT_OBJECT_0)
+      return false;
+    arm();
+    return true;
+  }
+#else
+  std::string path;
+  // QSettings rewrites the file and renames it over the old one, so a save changes the inode too
+  struct stat last = {};
+
+  void open() {
+    path = QSettings().fileName().toStdString();
+    stat(path.c_str(), &last);
+  }
+
+  bool arm() {
+    return true;
+  }
+
+  bool check() {
+    struct stat now = {};
+    stat(path.c_str(), &now);
+    const bool same = now.st_ino == last.st_ino && now.st_size == last.st_size && now.st_mtime == last.st_mtime;
+    last = now;
+    return !same;
+  }
+#endif
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     SettingsWatch
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+SettingsWatch::~SettingsWatch() {}
+
+SettingsWatch::SettingsWatch()
+: data(std::make_unique<Data>())
+{}
+
+bool SettingsWatch::changed() {
+  if (!d().armed) {
+    d().open();
+    d().arm();
+    d().armed = true;
+    return true;
+  }
+  return d().check();
+}
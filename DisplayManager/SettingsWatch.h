@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+
+// Notices changes to this application's settings made by any process, the window and the daemon
+// both save profiles. Checking costs no settings read and no allocation once armed: a registry
+// change notification on Windows, the ini file's identity and modification time elsewhere.
+// Only called from the thread that first calls changed().
+class SettingsWatch : NONCOPY {
+  PIMPL
+
+public:
+  ~SettingsWatch();
+  SettingsWatch();
+
+  // true if the settings may have changed since the last call, and on the first
+  bool changed();
+};
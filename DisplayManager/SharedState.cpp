@@ -0,0 +1,259 @@
+#include "SharedState.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <QDebug>
+#include <QSharedMemory>
+
+namespace {
+  const char * segment_key = "DisplayManager.state";
+  const uint32_t magic = 0x444D5354;   // "DMST"
+  // 2 carries inputs as words, 1 had them as text
+  const uint32_t layout = 2;
+  const int segment_size = 64 * 1024;
+
+  struct Header {
+    uint32_t magic;
+    uint32_t layout;
+    std::atomic<uint32_t> sequence;
+    uint32_t length;
+  };
+
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "shared sequence must be a plain word");
+
+  const int capacity = segment_size - int(sizeof(Header));
+
+  class Writer {
+    std::vector<char>& out;
+  public:
+    Writer(std::vector<char>& _out) : out(_out) {}
+
+    void word(uint32_t value) {
+      const char* bytes = reinterpret_cast<const char*>(&value);
+      out.insert(out.end(), bytes, bytes + sizeof(value));
+    }
+    void text(const std::string& value) {
+      word(uint32_t(value.size()));
+      out.insert(out.end(), value.begin(), value.end());
+    }
+  };
+
+  class Reader {
+    const char* at;
+    const char* const end;
+  public:
+    Reader(const char* begin, size_t length) : at(begin), end(begin + length) {}
+
+    bool word(uint32_t& value) {
+      if (end - at < (ptrdiff_t)sizeof(value))
+        return false;
+      std::memcpy(&value, at, sizeof(value));
+      at += sizeof(value);
+      return true;
+    }
+    bool text(std::string& value) {
+      uint32_t size = 0;
+      if (!word(size) || uint32_t(end - at) < size)
+        return false;
+      value.assign(at, size);
+      at += size;
+      return true;
+    }
+  };
+
+  void encode(const SharedSnapshot& snapshot, std::vector<char>& out) {
+    Writer writer(out);
+    writer.word(snapshot.version);
+    writer.text(snapshot.profile);
+    writer.word(uint32_t(snapshot.brightness));
+    writer.word(uint32_t(snapshot.contrast));
+    writer.word(uint32_t(snapshot.displays.size()));
+    for (auto& display : snapshot.displays) {
+      writer.text(display.serial);
+      writer.text(display.name);
+      writer.word(display.input.value());
+      writer.word(uint32_t(display.sources.size()));
+      for (auto& source : display.sources) {
+        writer.text(source.first);
+        writer.word(source.second.value());
+      }
+    }
+  }
+
+  bool decode(const char* begin, size_t length, SharedSnapshot& snapshot) {
+    Reader reader(begin, length);
+    uint32_t brightness, contrast, count;
+    if (!reader.word(snapshot.version) || !reader.text(snapshot.profile) || !reader.word(brightness) || !reader.word(contrast) || !reader.word(count))
+      return false;
+    snapshot.brightness = int(brightness);
+    snapshot.contrast = int(contrast);
+
+    snapshot.displays.clear();
+    for (uint32_t i = 0; i < count; ++i) {
+      SharedDisplay display;
+      uint32_t input, sources;
+      if (!reader.text(display.serial) || !reader.text(display.name) || !reader.word(input) || !reader.word(sources))
+        return false;
+      display.input = VcpValue(uint16_t(input));
+      for (uint32_t j = 0; j < sources; ++j) {
+        std::string name;
+        uint32_t mode;
+        if (!reader.text(name) || !reader.word(mode))
+          return false;
+        display.sources.push_back(std::make_pair(std::move(name), VcpValue(uint16_t(mode))));
+      }
+      snapshot.displays.push_back(std::move(display));
+    }
+    return true;
+  }
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     SharedStatePublisher
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+class SharedStatePublisher::Data {
+public:
+  QSharedMemory segment;
+  Header* header = nullptr;
+  uint32_t version = 0;
+  std::vector<char> buffer;
+
+  Data() : segment(segment_key) {}
+};
+
+SharedStatePublisher::~SharedStatePublisher() {}
+
+SharedStatePublisher::SharedStatePublisher()
+: data(std::make_unique<Data>())
+{}
+
+bool SharedStatePublisher::open() {
+  auto& segment = d().segment;
+  // a daemon that died without cleaning up can leave the segment behind
+  if (!segment.create(segment_size) && !(segment.error() == QSharedMemory::AlreadyExists && segment.attach())) {
+    qWarning() << "Could not create shared state" << segment.errorString();
+    return false;
+  }
+  if (segment.size() < segment_size) {
+    qWarning() << "Shared state segment is too small";
+    return false;
+  }
+
+  d().header = new (segment.data()) Header;
+  d().header->magic = magic;
+  d().header->layout = layout;
+  d().header->sequence.store(0, std::memory_order_relaxed);
+  d().header->length = 0;
+  return true;
+}
+
+bool SharedStatePublisher::publish(SharedSnapshot& snapshot) {
+  auto* header = d().header;
+  if (!header)
+    return false;
+
+  snapshot.version = ++d().version;
+  d().buffer.clear();
+  encode(snapshot, d().buffer);
+  if ((int)d().buffer.size() > capacity) {
+    qWarning() << "Shared state doesn't fit," << d().buffer.size() << "bytes";
+    return false;
+  }
+
+  // odd while the payload is being rewritten
+  const uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+  header->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  std::memcpy(reinterpret_cast<char*>(header + 1), d().buffer.data(), d().buffer.size());
+  header->length = uint32_t(d().buffer.size());
+
+  header->sequence.store(sequence + 2, std::memory_order_release);
+  return true;
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     SharedStateReader
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+class SharedStateReader::Data {
+public:
+  QSharedMemory segment;
+  const Header* header = nullptr;
+  mutable std::vector<char> buffer;
+
+  Data() : segment(segment_key) {}
+};
+
+SharedStateReader::~SharedStateReader() {}
+
+SharedStateReader::SharedStateReader()
+: data(std::make_unique<Data>())
+{}
+
+bool SharedStateReader::attach() {
+  auto& segment = d().segment;
+  if (!segment.attach(QSharedMemory::ReadOnly) || segment.size() < segment_size)
+    return false;
+
+  d().header = static_cast<const Header*>(segment.constData());
+  return d().header->magic == magic && d().header->layout == layout;
+}
+
+bool SharedStateReader::read(SharedSnapshot& snapshot) const {
+  const auto* header = d().header;
+  if (!header)
+    return false;
+
+  auto& buffer = d().buffer;
+  buffer.resize(capacity);
+  while (true) {
+    const uint32_t before = header->sequence.load(std::memory_order_acquire);
+    if (before == 0)
+      return false;
+    if (before & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    const uint32_t length = std::min<uint32_t>(header->length, capacity);
+    std::memcpy(buffer.data(), reinterpret_cast<const char*>(header + 1), length);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->sequence.load(std::memory_order_relaxed) != before)
+      continue;
+
+    return decode(buffer.data(), length, snapshot);
+  }
+}
+
+
+int runPrintState() {
+  SharedStateReader reader;
+  SharedSnapshot snapshot;
+  if (!reader.attach() || !reader.read(snapshot)) {
+    std::cerr << "DisplayManager daemon is not publishing state" << std::endl;
+    return 1;
+  }
+
+  std::cout << "version " << snapshot.version << std::endl;
+  std::cout << "profile " << (snapshot.profile.empty() ? "??" : snapshot.profile) << std::endl;
+  std::cout << "brightness " << snapshot.brightness << std::endl;
+  std::cout << "contrast " << snapshot.contrast << std::endl;
+  for (auto& display : snapshot.displays) {
+    std::cout << "display " << display.serial << " " << (display.input.valid() ? display.input.toString() : "??") << " " << display.name;
+    for (auto& source : display.sources)
+      std::cout << " [" << source.second.toString() << " " << source.first << "]";
+    std::cout << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.h"
+#include "monitors.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Device state published by the daemon for any number of local readers (tray helpers, scripts).
+// The segment starts with a sequence counter that is odd while a write is in progress, readers
+// copy the payload and retry if the counter moved, so they never block the daemon, never take
+// a lock and never cause DDC traffic.
+struct SharedDisplay {
+  std::string serial;
+  std::string name;
+  // last input read from the display, not valid if unknown
+  VcpValue input;
+  DisplayObject::sourceList sources;
+};
+
+struct SharedSnapshot {
+  // bumped on every publish
+  uint32_t version = 0;
+  std::string profile;
+  // last requested brightness and contrast in percent, -1 if never set
+  int brightness = -1;
+  int contrast = -1;
+  std::vector<SharedDisplay> displays;
+};
+
+class SharedStatePublisher : NONCOPY {
+  PIMPL
+
+public:
+  ~SharedStatePublisher();
+  SharedStatePublisher();
+
+  bool open();
+  // false if the snapshot doesn't fit the segment
+  bool publish(SharedSnapshot& snapshot);
+};
+
+class SharedStateReader : NONCOPY {
+  PIMPL
+
+public:
+  ~SharedStateReader();
+  SharedStateReader();
+
+  bool attach();
+  // a consistent copy, false if no daemon has published yet
+  bool read(SharedSnapshot& snapshot) const;
+};
+
+// prints the published state, for scripts, returns a process exit code
+int runPrintState();
@@ -0,0 +1,499 @@
+#include "SimulatedBackend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  // input sets handed out round robin, so a farm has a mix of panels
+  const char * const input_sets[] = {
+    "0F 11 12"
+  , "0F 10 11"
+  , "03 0F 11"
+  };
+
+  std::vector<uint8_t> makeEDID(int index, const std::string& serial) {
+    std::vector<uint8_t> edid(128, 0);
+    const uint8_t header[] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+    std::copy(std::begin(header), std::end(header), edid.begin());
+
+    // manufacturer "SIM", three 5 bit letters big endian
+    const uint16_t manufacturer = (('S' - '@') << 10) | (('I' - '@') << 5) | ('M' - '@');
+    edid[8] = manufacturer >> 8;
+    edid[9] = manufacturer & 0xFF;
+    edid[10] = index & 0xFF;
+    edid[11] = (index >> 8) & 0xFF;
+    for (int i = 0; i < 4; ++i)
+      edid[12 + i] = (index >> (8 * i)) & 0xFF;
+    edid[16] = 1;
+    edid[17] = 30;   // 2020
+    edid[18] = 1;
+    edid[19] = 4;
+
+    // display descriptors: name then serial, padded with a newline and spaces
+    auto descriptor = [&](int offset, uint8_t tag, const std::string& text) {
+      edid[offset + 3] = tag;
+      for (int i = 0; i < 13; ++i) {
+        if (i < (int)text.size())
+          edid[offset + 5 + i] = text[i];
+        else
+          edid[offset + 5 + i] = i == (int)text.size() ? 0x0A : 0x20;
+      }
+    };
+    char name[14];
+    std::snprintf(name, sizeof(name), "SIM %d", index);
+    descriptor(54, 0xFC, name);
+    descriptor(72, 0xFF, serial);
+
+    unsigned sum = 0;
+    for (int i = 0; i < 127; ++i)
+      sum += edid[i];
+    edid[127] = (256 - sum % 256) % 256;
+    return edid;
+  }
+
+  std::string makeCapabilities(int index) {
+    char model[16];
+    std::snprintf(model, sizeof(model), "SIM%04d", index);
+    return std::string("(prot(monitor)type(lcd)model(") + model + ")cmds(01 02 03 07 0C E3 F3)"
+      "vcp(02 04 05 08 10 12 14(05 08 0B) 16 18 1A 52 60(" + input_sets[index % 3] + ") 62 AC AE B6 C6 C8 C9 D6(01 04 05) DF)"
+      "mswhql(1)asset_eep(40)mccs_ver(2.2))";
+  }
+}
+
+struct SimulatedBus {
+  std::mutex lock;
+};
+
+struct SimulatedMonitor {
+  int index;
+  std::string serial;
+  std::wstring name;
+  std::wstring hardware_id;
+  std::vector<uint8_t> edid;
+  std::string capabilities;
+  std::vector<uint32_t> inputs;
+  double latency_ms;
+  std::shared_ptr<SimulatedBus> bus;
+  DisplayLocation location;
+
+  std::atomic<uint64_t> operations;
+
+  // guards everything below
+  std::mutex state;
+  std::mt19937 random;
+  std::map<uint8_t, std::pair<uint32_t, uint32_t>> vcp;   // code -> current, max
+  std::deque<uint8_t> active_control;                     // controls changed on the panel, read through 0x52
+  bool resyncing = false;
+  uint32_t pending_input = 0;
+  Clock::time_point resync_end;
+
+  SimulatedMonitor() : operations(0) {}
+
+  // finishes an input change once the panel has had time to resync
+  void settle(Clock::time_point now) {
+    if (resyncing && now >= resync_end) {
+      resyncing = false;
+      vcp[0x60].first = pending_input;
+    }
+  }
+};
+
+class SimulatedFarm::Data {
+public:
+  SimulatorConfig config;
+  std::vector<std::unique_ptr<SimulatedMonitor>> monitors;
+  std::function<void(int, uint8_t)> write_observer;
+
+  Data(const SimulatorConfig& _config)
+  : config(_config)
+  {
+    std::vector<std::shared_ptr<SimulatedBus>> buses;
+    const int bus_count = config.buses > 0 ? config.buses : config.displays;
+    for (int i = 0; i < bus_count; ++i)
+      buses.push_back(std::make_shared<SimulatedBus>());
+
+    for (int i = 0; i < config.displays; ++i) {
+      auto monitor = std::make_unique<SimulatedMonitor>();
+      char serial[16];
+      std::snprintf(serial, sizeof(serial), "SIM%05d", i);
+
+      monitor->index = i;
+      monitor->serial = serial;
+      monitor->name = L"Simulated " + std::to_wstring(i + 1);
+      monitor->hardware_id = L"SIM" + std::to_wstring(i);
+      monitor->edid = makeEDID(i, monitor->serial);
+      monitor->capabilities = makeCapabilities(i);
+      monitor->latency_ms = config.latency_ms;
+      for (auto& slow : config.slow) {
+        if (slow.first == i)
+          monitor->latency_ms = slow.second;
+      }
+      monitor->bus = buses[i % bus_count];
+      monitor->location.connector = L"SIM-" + std::to_wstring(i);
+      monitor->location.bus = i % bus_count;
+      monitor->random.seed(config.seed * 1000003u + i);
+
+      std::istringstream codes(input_sets[i % 3]);
+      std::string code;
+      while (codes >> code)
+        monitor->inputs.push_back(std::stoi(code, 0, 16));
+
+      // some panels report brightness and contrast on a 0-255 scale rather than 0-100
+      const uint32_t range = i % 3 == 2 ? 255u : 100u;
+      monitor->vcp[0x10] = std::make_pair(range / 2, range);
+      monitor->vcp[0x12] = std::make_pair(range / 2, range);
+      monitor->vcp[0x52] = std::make_pair(0u, 255u);
+      monitor->vcp[0x60] = std::make_pair(monitor->inputs.front(), monitor->inputs.back());
+      monitor->vcp[0x62] = std::make_pair(30u, 100u);
+      monitor->vcp[0xD6] = std::make_pair(1u, 5u);
+
+      monitors.push_back(std::move(monitor));
+    }
+  }
+
+  void sleep(double ms) const {
+    const double scaled = ms * config.time_scale;
+    if (scaled > 0)
+      std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(scaled));
+  }
+
+  enum class Outcome { ok, no_reply, corrupt };
+
+  // decides how one request/reply exchange goes and how long it takes in milliseconds,
+  // without waiting for it
+  Outcome draw(SimulatedMonitor& monitor, double& latency) const {
+    monitor.operations++;
+
+    std::lock_guard<std::mutex> lock(monitor.state);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    latency = monitor.latency_ms + config.jitter_ms * unit(monitor.random);
+
+    monitor.settle(Clock::now());
+    if (monitor.resyncing || unit(monitor.random) < config.error_rate)
+      return Outcome::no_reply;
+    if (unit(monitor.random) < config.checksum_rate)
+      return Outcome::corrupt;
+    return Outcome::ok;
+  }
+
+  // one request/reply exchange, holding the (possibly shared) bus for its duration
+  Outcome transact(SimulatedMonitor& monitor) const {
+    std::lock_guard<std::mutex> bus(monitor.bus->lock);
+    double latency;
+    const auto outcome = draw(monitor, latency);
+    sleep(latency);
+    return outcome;
+  }
+
+  std::chrono::microseconds scaled(double ms) const {
+    return std::chrono::microseconds((long long)(ms * config.time_scale * 1000));
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     SimulatedTransport
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+class SimulatedTransport final : public DisplayTransport {
+  const std::shared_ptr<SimulatedFarm> farm;
+  SimulatedMonitor& monitor;
+  // the outcome of a split phase request, between begin and finish
+  SimulatedFarm::Data::Outcome pending = SimulatedFarm::Data::Outcome::ok;
+
+  const SimulatedFarm::Data& sim() const { return farm->d(); }
+
+  Reply lookup(uint8_t code) {
+    std::lock_guard<std::mutex> lock(monitor.state);
+    monitor.settle(Clock::now());
+    const auto iter = monitor.vcp.find(code);
+    if (iter == monitor.vcp.end())
+      return Reply{ false, 0, 0 };
+    if (code == 0x52) {
+      const uint32_t changed = monitor.active_control.empty() ? 0 : monitor.active_control.front();
+      if (!monitor.active_control.empty())
+        monitor.active_control.pop_front();
+      return Reply{ true, changed, iter->second.second };
+    }
+    return Reply{ true, iter->second.first, iter->second.second };
+  }
+
+  bool apply(uint8_t code, uint32_t value) {
+    if (sim().write_observer)
+      sim().write_observer(monitor.index, code);
+
+    std::lock_guard<std::mutex> lock(monitor.state);
+    const auto iter = monitor.vcp.find(code);
+    if (iter == monitor.vcp.end())
+      return false;
+
+    if (code == 0x60) {
+      if (std::find(monitor.inputs.begin(), monitor.inputs.end(), value) == monitor.inputs.end())
+        return true;   // panels silently ignore inputs they don't have
+      if (value == iter->second.first && !monitor.resyncing)
+        return true;
+
+      monitor.resyncing = true;
+      monitor.pending_input = value;
+      monitor.resync_end = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double, std::milli>(sim().config.resync_ms * sim().config.time_scale));
+      monitor.settle(Clock::now());
+      return true;
+    }
+
+    iter->second.first = std::min(value, iter->second.second);
+    return true;
+  }
+
+public:
+  SimulatedTransport(std::shared_ptr<SimulatedFarm> _farm, int index)
+  : farm(std::move(_farm))
+  , monitor(*farm->d().monitors.at(index))
+  {}
+
+  // the string comes back in 32 byte fragments, a corrupted fragment is asked for again
+  std::string capabilities() override {
+    const int retries = 3;
+
+    std::string result, fragment;
+    int attempt = 0;
+    while (true) {
+      if (!capabilitiesFragment((uint16_t)result.size(), fragment)) {
+        if (++attempt > retries)
+          return std::string();
+        continue;
+      }
+      attempt = 0;
+      if (fragment.empty())
+        return result;
+      result += fragment;
+    }
+  }
+
+  bool capabilitiesFragment(uint16_t offset, std::string& fragment) override {
+    const size_t length = 32;
+    if (sim().transact(monitor) != SimulatedFarm::Data::Outcome::ok)
+      return false;
+    fragment = offset < monitor.capabilities.size() ? monitor.capabilities.substr(offset, length) : std::string();
+    return true;
+  }
+
+  Reply getVCP(uint8_t code) override {
+    if (sim().transact(monitor) != SimulatedFarm::Data::Outcome::ok)
+      return Reply{ false, 0, 0 };
+    return lookup(code);
+  }
+
+  bool setVCP(uint8_t code, uint32_t value) override {
+    if (sim().transact(monitor) != SimulatedFarm::Data::Outcome::ok)
+      return false;
+    return apply(code, value);
+  }
+
+  // the caller owns the bus between begin and finish, the reply is formed when it is collected
+  std::chrono::microseconds beginGetVCP(uint8_t /*code*/) override {
+    double latency;
+    pending = sim().draw(monitor, latency);
+    return sim().scaled(latency);
+  }
+  Reply finishGetVCP(uint8_t code) override {
+    if (pending != SimulatedFarm::Data::Outcome::ok)
+      return Reply{ false, 0, 0 };
+    return lookup(code);
+  }
+
+  // the write lands as soon as it is sent, the delay only keeps the bus quiet
+  std::chrono::microseconds beginSetVCP(uint8_t code, uint32_t value) override {
+    double latency;
+    pending = sim().draw(monitor, latency);
+    if (pending == SimulatedFarm::Data::Outcome::ok && !apply(code, value))
+      pending = SimulatedFarm::Data::Outcome::no_reply;
+    return sim().scaled(latency);
+  }
+  bool finishSetVCP(uint8_t /*code*/, uint32_t /*value*/) override {
+    return pending == SimulatedFarm::Data::Outcome::ok;
+  }
+};
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     SimulatorConfig
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+SimulatorConfig SimulatorConfig::parse(const std::string& source) {
+  SimulatorConfig result;
+
+  std::istringstream stream(source);
+  std::string pair;
+  while (std::getline(stream, pair, ',')) {
+    const auto split = pair.find('=');
+    if (split == std::string::npos)
+      continue;
+    const auto key = pair.substr(0, split);
+    const auto value = pair.substr(split + 1);
+
+    if (key == "displays")
+      result.displays = std::max(1, std::stoi(value));
+    else if (key == "buses")
+      result.buses = std::max(0, std::stoi(value));
+    else if (key == "latency")
+      result.latency_ms = std::stod(value);
+    else if (key == "jitter")
+      result.jitter_ms = std::stod(value);
+    else if (key == "resync")
+      result.resync_ms = std::stod(value);
+    else if (key == "errors")
+      result.error_rate = std::stod(value);
+    else if (key == "checksum")
+      result.checksum_rate = std::stod(value);
+    else if (key == "scale")
+      result.time_scale = std::stod(value);
+    else if (key == "seed")
+      result.seed = std::stoul(value);
+    else if (key == "slow") {
+      std::istringstream entries(value);
+      std::string entry;
+      while (std::getline(entries, entry, '/')) {
+        const auto colon = entry.find(':');
+        if (colon != std::string::npos)
+          result.slow.push_back(std::make_pair(std::stoi(entry.substr(0, colon)), std::stod(entry.substr(colon + 1))));
+      }
+    }
+  }
+
+  return result;
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     SimulatedFarm
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+SimulatedFarm::~SimulatedFarm() {}
+
+SimulatedFarm::SimulatedFarm(const SimulatorConfig& config)
+: data(std::make_unique<Data>(config))
+{}
+
+int SimulatedFarm::size() const {
+  return (int)d().monitors.size();
+}
+
+const SimulatorConfig& SimulatedFarm::config() const {
+  return d().config;
+}
+
+const std::string& SimulatedFarm::serial(int display) const {
+  return d().monitors.at(display)->serial;
+}
+
+const std::vector<uint8_t>& SimulatedFarm::edid(int display) const {
+  return d().monitors.at(display)->edid;
+}
+
+const std::string& SimulatedFarm::capabilities(int display) const {
+  return d().monitors.at(display)->capabilities;
+}
+
+uint32_t SimulatedFarm::vcp(int display, uint8_t code) const {
+  auto& monitor = *d().monitors.at(display);
+  std::lock_guard<std::mutex> lock(monitor.state);
+  monitor.settle(Clock::now());
+  const auto iter = monitor.vcp.find(code);
+  return iter != monitor.vcp.end() ? iter->second.first : 0;
+}
+
+void SimulatedFarm::press(int display, uint8_t code, uint32_t value) {
+  auto& monitor = *d().monitors.at(display);
+  std::lock_guard<std::mutex> lock(monitor.state);
+  const auto iter = monitor.vcp.find(code);
+  if (iter == monitor.vcp.end())
+    return;
+
+  // the panel's own menu wins over an input change still resyncing
+  if (code == 0x60)
+    monitor.resyncing = false;
+  iter->second.first = std::min(value, iter->second.second);
+  monitor.active_control.push_back(code);
+}
+
+uint64_t SimulatedFarm::operations() const {
+  uint64_t result = 0;
+  for (auto& monitor : d().monitors)
+    result += monitor->operations;
+  return result;
+}
+
+uint64_t SimulatedFarm::operations(int display) const {
+  return d().monitors.at(display)->operations;
+}
+
+void SimulatedFarm::resetCounters() {
+  for (auto& monitor : d().monitors)
+    monitor->operations = 0;
+}
+
+void SimulatedFarm::setWriteObserver(std::function<void(int, uint8_t)> observer) {
+  d().write_observer = std::move(observer);
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     SimulatedBackend
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+SimulatedBackend::SimulatedBackend(const SimulatorConfig& config)
+: farm(std::make_shared<SimulatedFarm>(config))
+{}
+
+SimulatedBackend::SimulatedBackend(std::shared_ptr<SimulatedFarm> _farm)
+: farm(std::move(_farm))
+{}
+
+const std::shared_ptr<SimulatedFarm>& SimulatedBackend::getFarm() const {
+  return farm;
+}
+
+void SimulatedBackend::enumerate(devices& result) {
+  for (auto& monitor : farm->d().monitors) {
+    result.push_back(DisplayObject(
+      std::make_unique<SimulatedTransport>(farm, monitor->index),
+      monitor->name, monitor->serial, monitor->hardware_id, monitor->location));
+  }
+}
+
+bool SimulatedBackend::enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) {
+  std::unordered_set<std::string> remaining(wanted.begin(), wanted.end());
+  for (auto& monitor : farm->d().monitors) {
+    if (remaining.empty())
+      break;
+
+    const auto serial = known.find(monitor->hardware_id);
+    if (serial == known.end())
+      return false;
+
+    if (!remaining.erase(serial->second))
+      continue;
+
+    result.push_back(DisplayObject(
+      std::make_unique<SimulatedTransport>(farm, monitor->index),
+      std::wstring(), serial->second, monitor->hardware_id, monitor->location));
+  }
+  return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "DisplayBackend.h"
+
+#include <cstdint>
+#include <functional>
+
+struct SimulatorConfig {
+  int displays = 2;
+  int buses = 0;              // displays are spread across this many shared buses, 0 gives each its own
+  double latency_ms = 40;     // per DDC transaction
+  double jitter_ms = 0;       // uniform extra latency on top
+  double resync_ms = 0;       // after an input change the panel doesn't answer for this long
+  double error_rate = 0;      // transactions that never get a reply
+  double checksum_rate = 0;   // replies that arrive corrupted
+  double time_scale = 1;      // multiplies every delay, 0 never sleeps
+  unsigned seed = 1;
+  std::vector<std::pair<int, double>> slow;   // per display latency overrides
+
+  // comma separated key=value pairs, unknown keys are ignored, e.g.
+  // "displays=8,buses=2,latency=40,jitter=5,resync=800,errors=0.01,checksum=0.02,scale=0.1,seed=7,slow=3:900/5:2000"
+  static SimulatorConfig parse(const std::string&);
+};
+
+// a set of virtual DDC/CI monitors, each with an EDID, capabilities string and VCP state
+class SimulatedFarm : public NONCOPY {
+  PIMPL
+  friend class SimulatedTransport;
+  friend class SimulatedBackend;
+
+public:
+  ~SimulatedFarm();
+  explicit SimulatedFarm(const SimulatorConfig&);
+
+  int size() const;
+  const SimulatorConfig& config() const;
+  const std::string& serial(int display) const;
+  const std::vector<uint8_t>& edid(int display) const;
+  const std::string& capabilities(int display) const;
+
+  // the value the panel is actually showing, without any bus traffic
+  uint32_t vcp(int display, uint8_t code) const;
+
+  // a control changed with the panel's own buttons, queued for the host to read through 0x52
+  void press(int display, uint8_t code, uint32_t value);
+
+  // DDC transactions issued, across the farm or for one display
+  uint64_t operations() const;
+  uint64_t operations(int display) const;
+  void resetCounters();
+
+  // called on the writing thread whenever a write reaches a panel, set it before any traffic
+  void setWriteObserver(std::function<void(int display, uint8_t code)>);
+};
+
+class SimulatedBackend final : public DisplayBackend {
+  std::shared_ptr<SimulatedFarm> farm;
+public:
+  explicit SimulatedBackend(const SimulatorConfig&);
+  explicit SimulatedBackend(std::shared_ptr<SimulatedFarm>);
+
+  const std::shared_ptr<SimulatedFarm>& getFarm() const;
+
+  void enumerate(devices& result) override;
+  bool enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) override;
+};
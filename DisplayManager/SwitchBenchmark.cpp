@@ -0,0 +1,443 @@
+#include "SwitchBenchmark.h"
+#include "AllocationCount.h"
+#include "DeviceWorker.h"
+#include "GlobalHotkeys.h"
+#include "SimulatedBackend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QFile>
+#include <QSemaphore>
+#include <QSettings>
+#include <QTextStream>
+#include <QTimer>
+
+namespace {
+  struct Scenario {
+    const char * name;
+    const char * config;
+  };
+
+  // scale compresses simulated time on the larger farms, so compare runs of the same scenario only
+  const Scenario scenarios[] = {
+    { "1x-fast",        "displays=1,latency=5,jitter=1,resync=20,seed=1" }
+  , { "4x-typical",     "displays=4,latency=40,jitter=10,resync=300,seed=2" }
+  , { "4x-shared-slow", "displays=4,buses=1,latency=40,jitter=20,resync=800,errors=0.02,checksum=0.02,slow=0:400,seed=3" }
+  , { "16x-typical",    "displays=16,latency=40,jitter=10,resync=300,scale=0.25,seed=4" }
+  , { "64x-fast",       "displays=64,latency=5,jitter=2,resync=50,scale=0.25,seed=5" }
+  , { "256x-wall",      "displays=256,buses=16,latency=5,jitter=1,resync=50,scale=0.05,seed=6" }
+    // never sleep, so their times are the worker, the engine and the display layer alone
+  , { "16x-overhead",   "displays=16,buses=4,latency=40,jitter=10,resync=300,scale=0,seed=7" }
+  , { "256x-overhead",  "displays=256,buses=16,latency=5,resync=50,scale=0,seed=8" }
+  };
+
+  // the one shipped with the build, bench/switch-baseline.txt in the source tree
+  const char * const default_baseline = ":/DisplayManager/bench/switch-baseline.txt";
+
+  // allowed growth in DDC transactions per switch over the baseline before a scenario counts as
+  // a regression. Simulated delays ride on the machine's timers, so times are only gated for the
+  // scenarios that never sleep (scale=0), where they measure the software alone, and with slack
+  // for scheduling noise
+  const double tolerance = 0.10;
+  const double time_tolerance = 0.25;
+  const double time_slack_ms = 1.0;
+
+  struct Result {
+    double p50;
+    double p95;
+    double p99;
+    double operations;
+    int unconfirmed;
+  };
+
+  double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty())
+      return 0;
+    const size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+  }
+
+  // blocks on a local event loop until the signal fires, false on timeout
+  template<typename Signal>
+  bool wait(DeviceWorker& worker, Signal signal, int timeout = 120000) {
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot(true);
+    QObject::connect(&timer, &QTimer::timeout, &loop, [&loop]() { loop.exit(1); });
+    QObject::connect(&worker, signal, &loop, [&loop]() { loop.exit(0); });
+    timer.start(timeout);
+    return loop.exec() == 0;
+  }
+
+  bool runScenario(const Scenario& scenario, int runs, Result& result) {
+    auto backend = std::make_shared<SimulatedBackend>(SimulatorConfig::parse(scenario.config));
+    const auto& farm = *backend->getFarm();
+    DeviceWorker worker(backend);
+
+    DisplayInfoList displays;
+    QObject::connect(&worker, &DeviceWorker::refreshed, &worker, [&displays](const DisplayInfoList& result) { displays = result; });
+    worker.refresh();
+    if (!wait(worker, &DeviceWorker::refreshed))
+      return false;
+
+    // two profiles using the first and second input each display advertises
+    std::vector<std::pair<uint32_t, uint32_t>> expected(farm.size());
+    {
+      QSettings settings;
+      for (auto& display : displays) {
+        if (display.sources.size() < 2)
+          continue;
+        const auto& a = display.sources[0].second;
+        const auto& b = display.sources[1].second;
+        settings.setValue("profiles/profile a/" + QString::fromStdString(display.serial), QString::fromStdString(a.toString()));
+        settings.setValue("profiles/profile b/" + QString::fromStdString(display.serial), QString::fromStdString(b.toString()));
+        for (int i = 0; i < farm.size(); ++i) {
+          if (farm.serial(i) == display.serial)
+            expected[i] = std::make_pair(uint32_t(a.value()), uint32_t(b.value()));
+        }
+      }
+    }
+
+    std::vector<double> samples;
+    uint64_t operations = 0;
+    result.unconfirmed = 0;
+    for (int run = 0; run < runs; ++run) {
+      const bool to_a = run % 2 == 0;
+      const uint64_t before = farm.operations();
+
+      const auto start = std::chrono::steady_clock::now();
+      worker.loadProfile(to_a ? QString("profile a") : QString("profile b"));
+      if (!wait(worker, &DeviceWorker::profileLoaded))
+        return false;
+      const auto end = std::chrono::steady_clock::now();
+
+      samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+      operations += farm.operations() - before;
+      for (int i = 0; i < farm.size(); ++i) {
+        if (farm.vcp(i, uint8_t(VcpCode::input_source)) != (to_a ? expected[i].first : expected[i].second))
+          result.unconfirmed++;
+      }
+    }
+
+    std::sort(samples.begin(), samples.end());
+    result.p50 = percentile(samples, 0.50);
+    result.p95 = percentile(samples, 0.95);
+    result.p99 = percentile(samples, 0.99);
+    result.operations = (double)operations / runs;
+    return true;
+  }
+
+  bool readBaseline(const QString& path, std::map<QString, Result>& result) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+      return false;
+
+    QTextStream stream(&file);
+    while (!stream.atEnd()) {
+      const auto fields = stream.readLine().split(' ', QString::SkipEmptyParts);
+      if (fields.size() != 5 || fields[0].startsWith('#'))
+        continue;
+      result[fields[0]] = Result{ fields[1].toDouble(), fields[2].toDouble(), fields[3].toDouble(), fields[4].toDouble(), 0 };
+    }
+    return true;
+  }
+
+  bool writeBaseline(const QString& path, const std::map<QString, Result>& results) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+      return false;
+
+    QTextStream stream(&file);
+    stream << "# scenario p50_ms p95_ms p99_ms ddc_ops_per_switch\n";
+    for (auto& pair : results)
+      stream << pair.first << ' ' << pair.second.p50 << ' ' << pair.second.p95 << ' ' << pair.second.p99 << ' ' << pair.second.operations << '\n';
+    return true;
+  }
+}
+
+int runSwitchBenchmark(const QStringList& args) {
+  const int runs = args.size() > 0 ? std::max(1, args[0].toInt()) : 20;
+  const QString baseline_path = args.size() > 1 && !args[1].startsWith("--") ? args[1] : QString(default_baseline);
+  const bool update = args.contains("--update");
+  if (update && baseline_path == default_baseline) {
+    std::cerr << "--update needs the baseline file to write, e.g. bench/switch-baseline.txt" << std::endl;
+    return 2;
+  }
+
+  // the benchmark writes its own profiles, keep them away from the user's
+  QCoreApplication::setApplicationName("Display Manager Benchmark");
+  QSettings().clear();
+  // polling for changes made on the panels adds traffic of its own
+  QSettings().setValue("ActiveControl/interval", 0);
+
+  std::map<QString, Result> baseline;
+  if (!update && !readBaseline(baseline_path, baseline)) {
+    std::cerr << "could not read baseline " << baseline_path.toStdString() << ", --update writes one" << std::endl;
+    return 2;
+  }
+  std::map<QString, Result> results;
+  bool regressed = false;
+
+  std::cout << std::left << std::setw(16) << "scenario"
+    << std::right << std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms"
+    << std::setw(10) << "ddc ops" << std::setw(13) << "unconfirmed" << std::endl;
+
+  for (auto& scenario : scenarios) {
+    Result result;
+    if (!runScenario(scenario, runs, result)) {
+      std::cerr << scenario.name << ": timed out" << std::endl;
+      return 1;
+    }
+    results[scenario.name] = result;
+
+    std::cout << std::left << std::setw(16) << scenario.name << std::right << std::fixed << std::setprecision(1)
+      << std::setw(10) << result.p50 << std::setw(10) << result.p95 << std::setw(10) << result.p99
+      << std::setw(10) << result.operations << std::setw(13) << result.unconfirmed;
+
+    const auto stored = baseline.find(scenario.name);
+    if (stored != baseline.end()) {
+      const bool timed = SimulatorConfig::parse(scenario.config).time_scale == 0;
+      const bool slower = timed && result.p95 > stored->second.p95 * (1 + time_tolerance) + time_slack_ms;
+      const bool chattier = result.operations > stored->second.operations * (1 + tolerance);
+      if (slower || chattier) {
+        regressed = true;
+        std::cout << "  REGRESSED (baseline p95 " << stored->second.p95 << " ms, " << stored->second.operations << " ops)";
+      }
+    }
+    else if (!update) {
+      std::cout << "  (not in the baseline)";
+    }
+    std::cout << std::endl;
+  }
+
+  if (update) {
+    if (!writeBaseline(baseline_path, results)) {
+      std::cerr << "could not write baseline " << baseline_path.toStdString() << std::endl;
+      return 1;
+    }
+    std::cout << "baseline written to " << baseline_path.toStdString() << std::endl;
+    return 0;
+  }
+
+  return regressed ? 1 : 0;
+}
+
+int runHotkeyBenchmark(const QStringList& args) {
+  using Clock = std::chrono::steady_clock;
+  const int runs = args.size() > 0 ? std::max(1, args[0].toInt()) : 100;
+
+  QCoreApplication::setApplicationName("Display Manager Benchmark");
+  QSettings().clear();
+  // polling for changes made on the panels adds traffic of its own
+  QSettings().setValue("ActiveControl/interval", 0);
+
+  auto backend = std::make_shared<SimulatedBackend>(SimulatorConfig::parse("displays=4,latency=0,resync=0,scale=0"));
+  auto& farm = *backend->getFarm();
+  DeviceWorker worker(backend);
+
+  DisplayInfoList displays;
+  QObject::connect(&worker, &DeviceWorker::refreshed, &worker, [&displays](const DisplayInfoList& result) { displays = result; });
+  worker.refresh();
+  if (!wait(worker, &DeviceWorker::refreshed)) {
+    std::cerr << "refresh timed out" << std::endl;
+    return 1;
+  }
+  {
+    QSettings settings;
+    for (auto& display : displays) {
+      if (display.sources.size() < 2)
+        continue;
+      settings.setValue("profiles/profile a/" + QString::fromStdString(display.serial), QString::fromStdString(display.sources[0].second.toString()));
+      settings.setValue("profiles/profile b/" + QString::fromStdString(display.serial), QString::fromStdString(display.sources[1].second.toString()));
+    }
+  }
+
+  // pressed and first write per run. pressed is filled on the hotkey thread, written by the
+  // observer on the worker thread, only for the first write after a press. both are read once
+  // the hotkey thread has stopped and the last switch was reported
+  std::vector<Clock::time_point> pressed(runs), written(runs);
+  // set by the hotkey thread, current before first, so a write that sees first sees its run
+  std::atomic<int> current{ -1 };
+  std::atomic<bool> first{ false };
+  farm.setWriteObserver([&](int, uint8_t) {
+    if (!first.exchange(false))
+      return;
+    const int run = current;
+    if (run >= 0)
+      written[run] = Clock::now();
+  });
+
+  // "* 8" spaced like a quick typist, with the next toggle only after the last one settled
+  std::vector<ReplayKeySource::Step> steps;
+  const auto key = [](KeyCode code, bool down) { return KeyEvent{ code, down, Clock::time_point() }; };
+  for (int run = 0; run < runs; ++run) {
+    steps.push_back(std::make_pair(std::chrono::microseconds(run == 0 ? 0 : 20000), key(KeyCode::numpad_multiply, true)));
+    steps.push_back(std::make_pair(std::chrono::microseconds(30000), key(KeyCode::numpad_multiply, false)));
+    steps.push_back(std::make_pair(std::chrono::microseconds(30000), key(KeyCode::numpad_8, true)));
+    steps.push_back(std::make_pair(std::chrono::microseconds(30000), key(KeyCode::numpad_8, false)));
+  }
+
+  // to_b only on the hotkey thread, loaded only in the profileLoaded slot on this one
+  bool to_b = true;
+  int loaded = 0;
+  QEventLoop loop;
+  QObject::connect(&worker, &DeviceWorker::profileLoaded, &loop, [&]() {
+    if (++loaded == runs)
+      loop.quit();
+  });
+
+  GlobalHotkeys hotkeys(std::make_unique<ReplayKeySource>(std::move(steps)));
+  hotkeys.bind({ KeyCode::numpad_multiply, KeyCode::numpad_8 }, [&](Clock::time_point time) {
+    const int run = current + 1;
+    pressed[run] = time;
+    current = run;
+    first = true;
+    // the displays start on their first input, so the first toggle goes to b
+    worker.loadProfile(to_b ? QString("profile b") : QString("profile a"));
+    to_b = !to_b;
+  });
+  hotkeys.start();
+  QTimer::singleShot(runs * 200 + 10000, &loop, [&loop]() { loop.exit(1); });
+  const bool finished = loop.exec() == 0;
+  hotkeys.stop();
+  farm.setWriteObserver(nullptr);
+
+  if (!finished) {
+    std::cerr << "only " << loaded << " of " << runs << " switches finished" << std::endl;
+    return 1;
+  }
+
+  std::vector<double> samples;
+  for (int run = 0; run < runs; ++run) {
+    if (written[run] >= pressed[run])
+      samples.push_back(std::chrono::duration<double, std::milli>(written[run] - pressed[run]).count());
+  }
+  std::sort(samples.begin(), samples.end());
+
+  std::cout << std::fixed << std::setprecision(3)
+    << "keypress to first write over " << samples.size() << " toggles: p50 " << percentile(samples, 0.50)
+    << " ms, p95 " << percentile(samples, 0.95) << " ms, p99 " << percentile(samples, 0.99) << " ms" << std::endl;
+  return samples.size() == size_t(runs) ? 0 : 1;
+}
+
+int runDispatchBenchmark(const QStringList& args) {
+  using Clock = std::chrono::steady_clock;
+  const int runs = args.size() > 0 ? std::max(1, args[0].toInt()) : 1000000;
+
+  auto backend = std::make_shared<SimulatedBackend>(SimulatorConfig::parse("displays=4,latency=0,resync=0,scale=0"));
+  const auto& farm = *backend->getFarm();
+  DisplayCollection collection(backend);
+  collection.refresh();
+  const auto& displays = collection.get();
+
+  // the panel state itself, what a fully inlined backend would still have to touch
+  uint64_t sink = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < runs; ++i)
+    sink += farm.vcp(i % farm.size(), 0x10);
+  const double direct = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / runs;
+
+  // the same read through DisplayObject, its transport and the simulated bus
+  start = Clock::now();
+  for (int i = 0; i < runs; ++i) {
+    uint32_t current = 0, max = 0;
+    displays[i % displays.size()].readRange(VcpCode::brightness, current, max);
+    sink += current;
+  }
+  const double layered = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / runs;
+
+  std::cout << std::fixed << std::setprecision(1)
+    << "vcp read over " << runs << " calls: panel state " << direct << " ns, through the display layer "
+    << layered << " ns, overhead " << layered - direct << " ns per transaction (checksum " << (sink & 0xFF) << ")" << std::endl;
+  return 0;
+}
+
+int runAllocationBenchmark(const QStringList& args) {
+  if (!AllocationCount::enabled()) {
+    std::cerr << "this build doesn't count allocations, build the Bench configuration (DM_ALLOC_COUNT)" << std::endl;
+    return 2;
+  }
+  const int runs = args.size() > 0 ? std::max(1, args[0].toInt()) : 200;
+  // the first loads read the profiles, and size the engine's queues, the results and the
+  // worker's log ring
+  const int warmup = 4;
+
+  QCoreApplication::setApplicationName("Display Manager Benchmark");
+  QSettings().clear();
+  // polling for changes made on the panels adds traffic of its own
+  QSettings().setValue("ActiveControl/interval", 0);
+
+  // no errors, so every display answers once it has resynced
+  auto backend = std::make_shared<SimulatedBackend>(SimulatorConfig::parse("displays=16,buses=4,latency=2,jitter=1,resync=10,seed=7"));
+  DeviceWorker worker(backend);
+
+  DisplayInfoList displays;
+  QObject::connect(&worker, &DeviceWorker::refreshed, &worker, [&displays](const DisplayInfoList& result) { displays = result; });
+  worker.refresh();
+  if (!wait(worker, &DeviceWorker::refreshed)) {
+    std::cerr << "refresh timed out" << std::endl;
+    return 1;
+  }
+  int switched = 0;
+  {
+    QSettings settings;
+    for (auto& display : displays) {
+      if (display.sources.size() < 2)
+        continue;
+      settings.setValue("profiles/profile a/" + QString::fromStdString(display.serial), QString::fromStdString(display.sources[0].second.toString()));
+      settings.setValue("profiles/profile b/" + QString::fromStdString(display.serial), QString::fromStdString(display.sources[1].second.toString()));
+      switched++;
+    }
+  }
+
+  // counted on the worker thread, from one profileLoaded to the next: taking the command off the
+  // queue, looking the profile up, the switch and emitting its signals. Posting the command
+  // allocates its queue node on this thread, and Qt copies the arguments of signals queued to
+  // other threads, there are none here. The slots are direct, so they run on the worker and
+  // only touch what was sized up front
+  std::vector<uint64_t> allocations(warmup + runs);
+  uint64_t last = 0;
+  int loaded = 0, unconfirmed = 0;
+  QSemaphore done;
+  QObject::connect(&worker, &DeviceWorker::switchReported, [&](const QString&, const SwitchResultList& results) {
+    for (auto& result : results) {
+      if (result.outcome != SwitchResult::confirmed)
+        unconfirmed++;
+    }
+  });
+  QObject::connect(&worker, &DeviceWorker::profileLoaded, [&](const QString&) {
+    const uint64_t now = AllocationCount::thisThread();
+    allocations[loaded++] = now - last;
+    last = now;
+    done.release();
+  });
+
+  const QString profiles[] = { "profile a", "profile b" };
+  for (int run = 0; run < warmup + runs; ++run) {
+    if (run == warmup)
+      unconfirmed = 0;
+    worker.loadProfile(profiles[run % 2]);
+    if (!done.tryAcquire(1, 60000)) {
+      std::cerr << "switch " << run << " timed out" << std::endl;
+      return 1;
+    }
+  }
+
+  uint64_t total = 0, worst = 0;
+  for (int run = warmup; run < warmup + runs; ++run) {
+    total += allocations[run];
+    worst = std::max(worst, allocations[run]);
+  }
+
+  std::cout << "allocations on the device worker over " << runs << " profile loads of " << switched << " displays: " << total
+    << " in all, at most " << worst << " in one load, " << unconfirmed << " unconfirmed" << std::endl;
+  return total == 0 && unconfirmed == 0 ? 0 : 1;
+}
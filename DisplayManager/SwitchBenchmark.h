@@ -0,0 +1,26 @@
+#pragma once
+
+#include <QStringList>
+
+// Drives trigger -> loadProfile -> every display confirmed through the real device worker,
+// against simulated farms of several sizes and latency profiles. Reports p50/p95/p99 switch
+// times and DDC transactions per switch.
+//
+// Each scenario is checked against a baseline, the one built in unless a file is given, and the
+// run fails if its DDC transactions per switch grew by more than the tolerance. Switch times are
+// only gated for the scenarios that never sleep. --update writes the given file instead.
+int runSwitchBenchmark(const QStringList& args);
+
+// Replays the toggle chord through GlobalHotkeys into a zero latency simulated farm and reports
+// keypress to first DDC write times, the software overhead of the hotkey path.
+int runHotkeyBenchmark(const QStringList& args);
+
+// Times VCP reads against a zero latency simulated farm, once straight from the panel state and
+// once through DisplayObject and its transport, to show what the layering costs per transaction.
+int runDispatchBenchmark(const QStringList& args);
+
+// Loads two profiles in turn through the real device worker against a simulated desk and counts
+// the heap allocations the worker thread makes for each load once warmed up, from taking the
+// command off its queue to profileLoaded. Fails if any load made one, or if this isn't a
+// DM_ALLOC_COUNT build.
+int runAllocationBenchmark(const QStringList& args);
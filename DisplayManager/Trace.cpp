@@ -0,0 +1,175 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  struct Event {
+    const char * name;
+    int track;
+    int64_t begin;
+    int64_t duration;
+  };
+
+  struct ThreadBuffer {
+    int tid;
+    std::string name;
+    std::mutex lock;
+    std::vector<Event> events;
+  };
+
+  std::atomic<bool> recording(false);
+  Clock::time_point origin;
+  std::string output;
+
+  std::mutex registry;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+  std::vector<std::string> tracks;
+
+  thread_local std::shared_ptr<ThreadBuffer> local;
+
+  int64_t now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - origin).count();
+  }
+
+  ThreadBuffer& buffer() {
+    if (!local) {
+      local = std::make_shared<ThreadBuffer>();
+      std::lock_guard<std::mutex> lock(registry);
+      local->tid = (int)buffers.size() + 1;
+      local->name = "thread " + std::to_string(local->tid);
+      local->events.reserve(1024);
+      buffers.push_back(local);
+    }
+    return *local;
+  }
+
+  std::string escape(const std::string& source) {
+    std::string result;
+    for (char c : source) {
+      if (c == '"' || c == '\\')
+        result += '\\';
+      result += c;
+    }
+    return result;
+  }
+
+  // threads and displays are separate processes in the viewer so their tracks group together
+  const int thread_pid = 1;
+  const int display_pid = 2;
+}
+
+bool Trace::start(const std::string& path) {
+  std::lock_guard<std::mutex> lock(registry);
+  for (auto& b : buffers) {
+    std::lock_guard<std::mutex> events(b->lock);
+    b->events.clear();
+  }
+  output = path;
+  origin = Clock::now();
+  recording = true;
+  return true;
+}
+
+void Trace::stop() {
+  if (!recording.exchange(false))
+    return;
+
+  std::lock_guard<std::mutex> lock(registry);
+  std::ofstream file(output, std::ios::out | std::ios::trunc);
+  if (!file)
+    return;
+
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+  file << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << thread_pid << ",\"args\":{\"name\":\"threads\"}}";
+  file << ",\n{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << display_pid << ",\"args\":{\"name\":\"displays\"}}";
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    file << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << display_pid << ",\"tid\":" << i
+      << ",\"args\":{\"name\":\"" << escape(tracks[i]) << "\"}}";
+  }
+
+  for (auto& b : buffers) {
+    std::lock_guard<std::mutex> events(b->lock);
+    file << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << thread_pid << ",\"tid\":" << b->tid
+      << ",\"args\":{\"name\":\"" << escape(b->name) << "\"}}";
+
+    for (auto& e : b->events) {
+      const bool on_display = e.track >= 0;
+      file << ",\n{\"ph\":\"X\",\"name\":\"" << e.name << "\",\"ts\":" << e.begin << ",\"dur\":" << e.duration
+        << ",\"pid\":" << (on_display ? display_pid : thread_pid) << ",\"tid\":" << (on_display ? e.track : b->tid);
+      if (on_display)
+        file << ",\"args\":{\"thread\":\"" << escape(b->name) << "\"}";
+      file << "}";
+    }
+    b->events.clear();
+  }
+
+  file << "\n]}\n";
+}
+
+bool Trace::active() {
+  return recording.load(std::memory_order_relaxed);
+}
+
+int Trace::track(const std::string& display) {
+  std::lock_guard<std::mutex> lock(registry);
+  for (size_t i = 0; i < tracks.size(); ++i) {
+    if (tracks[i] == display)
+      return (int)i;
+  }
+  tracks.push_back(display);
+  return (int)tracks.size() - 1;
+}
+
+void Trace::nameThread(const char* name) {
+  auto& b = buffer();
+  std::lock_guard<std::mutex> lock(b.lock);
+  b.name = name;
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     TraceSpan
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+TraceSpan::TraceSpan(const char* _name, int _track)
+: name(_name)
+, track(_track)
+, begin(Trace::active() ? now() : -1)
+{}
+
+TraceSpan::~TraceSpan() {
+  if (begin < 0 || !Trace::active())
+    return;
+
+  const int64_t end = now();
+  auto& b = buffer();
+  std::lock_guard<std::mutex> lock(b.lock);
+  b.events.push_back(Event{ name, track, begin, end - begin });
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     TraceSession
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+TraceSession::TraceSession() {
+#ifdef DM_TRACE
+  const char* path = std::getenv("DISPLAYMANAGER_TRACE");
+  if (path && *path)
+    Trace::start(path);
+#endif
+}
+
+TraceSession::~TraceSession() {
+  Trace::stop();
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstdint>
+#include <string>
+
+// Chrome/Perfetto trace-event timeline. Spans are compiled in with DM_TRACE and only recorded
+// while a session is active, so a build can ship with them and pay one atomic load per span.
+// Each thread gets its own track, and every display gets one more that its DDC traffic lands on.
+class Trace {
+public:
+  // begins recording, the file is written by stop()
+  static bool start(const std::string& path);
+  static void stop();
+  static bool active();
+
+  // track id for a display, -1 while tracing is compiled out
+  static int track(const std::string& display);
+  static void nameThread(const char* name);
+};
+
+class TraceSpan : public NONCOPY {
+  const char * const name;
+  const int track;
+  int64_t begin;
+public:
+  TraceSpan(const char* name, int track = -1);
+  ~TraceSpan();
+};
+
+// records from construction to the end of main, when DISPLAYMANAGER_TRACE names an output file
+class TraceSession : public NONCOPY {
+public:
+  TraceSession();
+  ~TraceSession();
+};
+
+#ifdef DM_TRACE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
+#define TRACE_DISPLAY_SCOPE(name, track) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name, track)
+#define TRACE_THREAD(name) Trace::nameThread(name)
+#define TRACE_TRACK(display) Trace::track(display)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_DISPLAY_SCOPE(name, track)
+#define TRACE_THREAD(name)
+#define TRACE_TRACK(display) (-1)
+#endif
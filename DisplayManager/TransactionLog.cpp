@@ -0,0 +1,546 @@
+#include "TransactionLog.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <QDebug>
+
+// file layout, native little endian:
+//   "DMDDCv3\n"
+//   records of  u8 kind, u16 display, u64 start us, u32 duration us, then per kind
+//     display       str serial, wstr name, wstr hardware id
+//     enumerate     -
+//     capabilities  str
+//     fragment      u16 offset, u8 ok, str
+//     get           u8 code, u8 ok, u32 current, u32 max
+//     set           u8 code, u32 value, u8 ok
+//   str is u32 length + bytes, wstr is u32 length + u32 per character
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  const char magic[8] = { 'D', 'M', 'D', 'D', 'C', 'v', '3', '\n' };
+
+  enum Kind : uint8_t {
+    kind_display = 1
+  , kind_enumerate
+  , kind_capabilities
+  , kind_get
+  , kind_set
+  , kind_fragment
+  };
+
+  class Encoder {
+  public:
+    std::string bytes;
+
+    template<typename T>
+    void put(T value) {
+      bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void put(const std::string& value) {
+      put(uint32_t(value.size()));
+      bytes += value;
+    }
+    void put(const std::wstring& value) {
+      put(uint32_t(value.size()));
+      for (wchar_t c : value)
+        put(uint32_t(c));
+    }
+  };
+
+  class Decoder {
+    std::istream& in;
+  public:
+    Decoder(std::istream& _in) : in(_in) {}
+
+    template<typename T>
+    bool get(T& value) {
+      return (bool)in.read(reinterpret_cast<char*>(&value), sizeof(value));
+    }
+    bool get(std::string& value) {
+      uint32_t size;
+      if (!get(size))
+        return false;
+      value.resize(size);
+      return size == 0 || (bool)in.read(&value[0], size);
+    }
+    bool get(std::wstring& value) {
+      uint32_t size;
+      if (!get(size))
+        return false;
+      value.clear();
+      for (uint32_t i = 0; i < size; ++i) {
+        uint32_t c;
+        if (!get(c))
+          return false;
+        value.push_back(wchar_t(c));
+      }
+      return true;
+    }
+  };
+
+  uint32_t micros(Clock::duration duration) {
+    return uint32_t(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+  }
+
+  // traces don't carry wiring, every replayed display gets a bus of its own
+  DisplayLocation location(int display) {
+    DisplayLocation result;
+    result.connector = L"REPLAY-" + std::to_wstring(display);
+    result.bus = display;
+    return result;
+  }
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     Recording
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+class TransactionRecorder : NONCOPY {
+  std::mutex lock;
+  std::ofstream out;
+  const Clock::time_point origin;
+  std::unordered_map<std::string, uint16_t> displays;
+
+public:
+  TransactionRecorder(const std::string& path)
+  : out(path, std::ios::binary | std::ios::trunc)
+  , origin(Clock::now())
+  {
+    out.write(magic, sizeof(magic));
+  }
+
+  bool good() const {
+    return out.good();
+  }
+
+  // starts a record, the caller appends the kind specific part
+  Encoder begin(Kind kind, uint16_t display, Clock::time_point start, Clock::time_point end) const {
+    Encoder record;
+    record.put(uint8_t(kind));
+    record.put(display);
+    record.put(uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(start - origin).count()));
+    record.put(micros(end - start));
+    return record;
+  }
+
+  // flushed every time, the trace is most wanted when the program didn't exit cleanly
+  void write(const Encoder& record) {
+    std::lock_guard<std::mutex> guard(lock);
+    out.write(record.bytes.data(), record.bytes.size());
+    out.flush();
+  }
+
+  uint16_t display(const DisplayObject& device) {
+    uint16_t index;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      const auto iter = displays.find(device.serial());
+      if (iter != displays.end())
+        return iter->second;
+      index = uint16_t(displays.size());
+      displays.emplace(device.serial(), index);
+    }
+
+    const auto now = Clock::now();
+    auto record = begin(kind_display, index, now, now);
+    record.put(device.serial());
+    record.put(device.name());
+    record.put(device.hardwareId());
+    write(record);
+    return index;
+  }
+};
+
+class RecordingTransport final : public DisplayTransport {
+  const std::shared_ptr<TransactionRecorder> recorder;
+  const uint16_t display;
+  const std::unique_ptr<DisplayTransport> inner;
+  // when the split phase request in flight was sent
+  Clock::time_point begun;
+
+  void recordGet(uint8_t code, const Reply& result, Clock::time_point start) {
+    auto record = recorder->begin(kind_get, display, start, Clock::now());
+    record.put(code);
+    record.put(uint8_t(result.ok));
+    record.put(result.current);
+    record.put(result.max);
+    recorder->write(record);
+  }
+
+  void recordSet(uint8_t code, uint32_t value, bool result, Clock::time_point start) {
+    auto record = recorder->begin(kind_set, display, start, Clock::now());
+    record.put(code);
+    record.put(value);
+    record.put(uint8_t(result));
+    recorder->write(record);
+  }
+
+public:
+  RecordingTransport(std::shared_ptr<TransactionRecorder> _recorder, uint16_t _display, std::unique_ptr<DisplayTransport> _inner)
+  : recorder(std::move(_recorder))
+  , display(_display)
+  , inner(std::move(_inner))
+  {}
+
+  std::string capabilities() override {
+    const auto start = Clock::now();
+    auto result = inner->capabilities();
+    auto record = recorder->begin(kind_capabilities, display, start, Clock::now());
+    record.put(result);
+    recorder->write(record);
+    return result;
+  }
+
+  bool capabilitiesFragment(uint16_t offset, std::string& fragment) override {
+    const auto start = Clock::now();
+    const bool result = inner->capabilitiesFragment(offset, fragment);
+    auto record = recorder->begin(kind_fragment, display, start, Clock::now());
+    record.put(offset);
+    record.put(uint8_t(result));
+    record.put(result ? fragment : std::string());
+    recorder->write(record);
+    return result;
+  }
+
+  Reply getVCP(uint8_t code) override {
+    const auto start = Clock::now();
+    const auto result = inner->getVCP(code);
+    recordGet(code, result, start);
+    return result;
+  }
+
+  bool setVCP(uint8_t code, uint32_t value) override {
+    const auto start = Clock::now();
+    const bool result = inner->setVCP(code, value);
+    recordSet(code, value, result, start);
+    return result;
+  }
+
+  // a split phase request is recorded as lasting from begin to finish
+  std::chrono::microseconds beginGetVCP(uint8_t code) override {
+    begun = Clock::now();
+    return inner->beginGetVCP(code);
+  }
+  Reply finishGetVCP(uint8_t code) override {
+    const auto result = inner->finishGetVCP(code);
+    recordGet(code, result, begun);
+    return result;
+  }
+
+  std::chrono::microseconds beginSetVCP(uint8_t code, uint32_t value) override {
+    begun = Clock::now();
+    return inner->beginSetVCP(code, value);
+  }
+  bool finishSetVCP(uint8_t code, uint32_t value) override {
+    const bool result = inner->finishSetVCP(code, value);
+    recordSet(code, value, result, begun);
+    return result;
+  }
+
+  std::chrono::microseconds busyFor() override {
+    return inner->busyFor();
+  }
+};
+
+class RecordingBackend::Data {
+public:
+  const std::shared_ptr<DisplayBackend> inner;
+  const std::shared_ptr<TransactionRecorder> recorder;
+
+  Data(std::shared_ptr<DisplayBackend> _inner, const std::string& path)
+  : inner(std::move(_inner))
+  , recorder(std::make_shared<TransactionRecorder>(path))
+  {}
+
+  void wrap(devices& result, size_t first, Clock::time_point start) {
+    recorder->write(recorder->begin(kind_enumerate, 0, start, Clock::now()));
+    for (size_t i = first; i < result.size(); ++i) {
+      const uint16_t display = recorder->display(result[i]);
+      auto recorder_ = recorder;
+      result[i].wrapTransport([recorder_, display](std::unique_ptr<DisplayTransport> transport) -> std::unique_ptr<DisplayTransport> {
+        return std::make_unique<RecordingTransport>(recorder_, display, std::move(transport));
+      });
+    }
+  }
+};
+
+RecordingBackend::~RecordingBackend() {}
+
+RecordingBackend::RecordingBackend(std::shared_ptr<DisplayBackend> inner, const std::string& path)
+: data(std::make_unique<Data>(std::move(inner), path))
+{}
+
+bool RecordingBackend::good() const {
+  return d().recorder->good();
+}
+
+void RecordingBackend::enumerate(devices& result) {
+  const size_t first = result.size();
+  const auto start = Clock::now();
+  d().inner->enumerate(result);
+  d().wrap(result, first, start);
+}
+
+bool RecordingBackend::enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) {
+  const size_t first = result.size();
+  const auto start = Clock::now();
+  const bool found = d().inner->enumerateCached(result, known, wanted);
+  d().wrap(result, first, start);
+  return found;
+}
+
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     Replay
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+class ReplayTrace : NONCOPY {
+public:
+  struct Entry {
+    uint32_t duration;
+    bool ok;
+    std::string capabilities;
+    DisplayTransport::Reply reply;
+  };
+
+  struct Display {
+    std::string serial;
+    std::wstring name;
+    std::wstring hardware_id;
+    // kind << 8 | code -> what the display did each time it was asked, in order
+    std::map<uint16_t, std::vector<Entry>> answers;
+    std::map<uint16_t, size_t> cursors;
+  };
+
+  const double speed;
+  std::vector<Display> displays;
+  std::vector<uint32_t> enumerations;
+  size_t enumeration_cursor = 0;
+  std::mutex lock;
+
+  ReplayTrace(double _speed) : speed(_speed) {}
+
+  bool load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char header[sizeof(magic)];
+    if (!in.read(header, sizeof(header)) || !std::equal(header, header + sizeof(header), magic))
+      return false;
+
+    Decoder decoder(in);
+    while (true) {
+      uint8_t kind;
+      uint16_t display;
+      uint64_t start;
+      uint32_t duration;
+      if (!decoder.get(kind))
+        return true;
+      if (!decoder.get(display) || !decoder.get(start) || !decoder.get(duration))
+        return false;
+
+      if (kind == kind_display) {
+        if (display >= displays.size())
+          displays.resize(display + 1);
+        auto& target = displays[display];
+        if (!decoder.get(target.serial) || !decoder.get(target.name) || !decoder.get(target.hardware_id))
+          return false;
+        continue;
+      }
+      if (kind == kind_enumerate) {
+        enumerations.push_back(duration);
+        continue;
+      }
+      if (display >= displays.size())
+        return false;
+
+      Entry entry{ duration, true, std::string(), DisplayTransport::Reply{ false, 0, 0 } };
+      uint8_t code = 0;
+      if (kind == kind_capabilities) {
+        if (!decoder.get(entry.capabilities))
+          return false;
+      }
+      else if (kind == kind_get) {
+        uint8_t ok;
+        if (!decoder.get(code) || !decoder.get(ok) || !decoder.get(entry.reply.current) || !decoder.get(entry.reply.max))
+          return false;
+        entry.reply.ok = ok != 0;
+      }
+      else if (kind == kind_fragment) {
+        uint16_t offset;
+        uint8_t ok;
+        if (!decoder.get(offset) || !decoder.get(ok) || !decoder.get(entry.capabilities))
+          return false;
+        entry.ok = ok != 0;
+      }
+      else if (kind == kind_set) {
+        uint32_t value;
+        uint8_t ok;
+        if (!decoder.get(code) || !decoder.get(value) || !decoder.get(ok))
+          return false;
+        entry.ok = ok != 0;
+      }
+      else {
+        return false;
+      }
+      displays[display].answers[uint16_t(kind << 8 | code)].push_back(std::move(entry));
+    }
+  }
+
+  std::chrono::microseconds delay(uint32_t duration) const {
+    return std::chrono::microseconds(speed > 0 ? (long long)(duration / speed) : 0);
+  }
+
+  void wait(uint32_t duration) const {
+    if (speed > 0)
+      std::this_thread::sleep_for(delay(duration));
+  }
+
+  // the next recorded answer, or the last one again once they ran out. the recorded time is
+  // waited out unless the caller does that itself
+  bool next(int display, Kind kind, uint8_t code, Entry& result, bool waited = true) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      auto& target = displays[display];
+      const uint16_t key = uint16_t(kind << 8 | code);
+      const auto iter = target.answers.find(key);
+      if (iter == target.answers.end())
+        return false;
+      auto& cursor = target.cursors[key];
+      result = iter->second[std::min(cursor, iter->second.size() - 1)];
+      ++cursor;
+    }
+    if (waited)
+      wait(result.duration);
+    return true;
+  }
+
+  void enumerated() {
+    uint32_t duration = 0;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (enumerations.empty())
+        return;
+      duration = enumerations[std::min(enumeration_cursor++, enumerations.size() - 1)];
+    }
+    wait(duration);
+  }
+};
+
+class ReplayTransport final : public DisplayTransport {
+  const std::shared_ptr<ReplayTrace> trace;
+  const int display;
+  // the answer to a split phase request, between begin and finish
+  bool found = false;
+  ReplayTrace::Entry pending;
+
+public:
+  ReplayTransport(std::shared_ptr<ReplayTrace> _trace, int _display)
+  : trace(std::move(_trace))
+  , display(_display)
+  {}
+
+  std::string capabilities() override {
+    ReplayTrace::Entry entry;
+    if (!trace->next(display, kind_capabilities, 0, entry))
+      return std::string();
+    return entry.capabilities;
+  }
+
+  // fragments are answered in recorded order, retries included, whatever offset is asked for
+  bool capabilitiesFragment(uint16_t offset, std::string& fragment) override {
+    ReplayTrace::Entry entry;
+    if (!trace->next(display, kind_fragment, 0, entry))
+      return DisplayTransport::capabilitiesFragment(offset, fragment);
+    fragment = entry.capabilities;
+    return entry.ok;
+  }
+
+  Reply getVCP(uint8_t code) override {
+    ReplayTrace::Entry entry;
+    if (!trace->next(display, kind_get, code, entry))
+      return Reply{ false, 0, 0 };
+    return entry.reply;
+  }
+
+  bool setVCP(uint8_t code, uint32_t /*value*/) override {
+    ReplayTrace::Entry entry;
+    return trace->next(display, kind_set, code, entry) && entry.ok;
+  }
+
+  std::chrono::microseconds beginGetVCP(uint8_t code) override {
+    found = trace->next(display, kind_get, code, pending, false);
+    return found ? trace->delay(pending.duration) : std::chrono::microseconds(0);
+  }
+  Reply finishGetVCP(uint8_t /*code*/) override {
+    return found ? pending.reply : Reply{ false, 0, 0 };
+  }
+
+  std::chrono::microseconds beginSetVCP(uint8_t code, uint32_t /*value*/) override {
+    found = trace->next(display, kind_set, code, pending, false);
+    return found ? trace->delay(pending.duration) : std::chrono::microseconds(0);
+  }
+  bool finishSetVCP(uint8_t /*code*/, uint32_t /*value*/) override {
+    return found && pending.ok;
+  }
+};
+
+class ReplayBackend::Data {
+public:
+  const std::shared_ptr<ReplayTrace> trace;
+  bool good;
+
+  Data(const std::string& path, double speed)
+  : trace(std::make_shared<ReplayTrace>(speed))
+  {
+    good = trace->load(path);
+    if (!good)
+      qWarning() << "Could not read DDC trace" << QString::fromStdString(path);
+  }
+};
+
+ReplayBackend::~ReplayBackend() {}
+
+ReplayBackend::ReplayBackend(const std::string& path, double speed)
+: data(std::make_unique<Data>(path, speed))
+{}
+
+bool ReplayBackend::good() const {
+  return d().good;
+}
+
+int ReplayBackend::size() const {
+  return (int)d().trace->displays.size();
+}
+
+void ReplayBackend::enumerate(devices& result) {
+  d().trace->enumerated();
+  const auto& displays = d().trace->displays;
+  for (int i = 0; i < (int)displays.size(); ++i)
+    result.push_back(DisplayObject(std::make_unique<ReplayTransport>(d().trace, i), displays[i].name, displays[i].serial, displays[i].hardware_id, location(i)));
+}
+
+bool ReplayBackend::enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) {
+  d().trace->enumerated();
+  std::unordered_set<std::string> remaining(wanted.begin(), wanted.end());
+  const auto& displays = d().trace->displays;
+  for (int i = 0; i < (int)displays.size() && !remaining.empty(); ++i) {
+    const auto serial = known.find(displays[i].hardware_id);
+    if (serial == known.end())
+      return false;
+
+    if (!remaining.erase(serial->second))
+      continue;
+
+    result.push_back(DisplayObject(std::make_unique<ReplayTransport>(d().trace, i), std::wstring(), serial->second, displays[i].hardware_id, location(i)));
+  }
+  return true;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "DisplayBackend.h"
+
+#include <string>
+
+// Records every capabilities, get and set transaction of the wrapped backend's displays, with
+// timings and results, to a compact binary trace. Set DISPLAYMANAGER_RECORD to a file name to
+// record whichever backend would otherwise be used.
+class RecordingBackend final : public DisplayBackend {
+  PIMPL
+
+public:
+  ~RecordingBackend();
+  RecordingBackend(std::shared_ptr<DisplayBackend> inner, const std::string& path);
+
+  bool good() const;
+
+  void enumerate(devices& result) override;
+  bool enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) override;
+};
+
+// Plays a recorded trace back as a set of displays. Each display answers every kind of request
+// with the next recorded result for it, repeating the last once the recording runs out, after
+// waiting as long as the original took divided by speed (0 doesn't wait at all).
+// Set DISPLAYMANAGER_REPLAY to a trace, and optionally DISPLAYMANAGER_REPLAY_SPEED.
+class ReplayBackend final : public DisplayBackend {
+  PIMPL
+
+public:
+  ~ReplayBackend();
+  ReplayBackend(const std::string& path, double speed = 1);
+
+  // false if the trace couldn't be read
+  bool good() const;
+  int size() const;
+
+  void enumerate(devices& result) override;
+  bool enumerateCached(devices& result, const identityMap& known, const std::vector<std::string>& wanted) override;
+};
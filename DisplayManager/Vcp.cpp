@@ -0,0 +1,34 @@
+#include "Vcp.h"
+
+std::string VcpValue::toString() const {
+  if (!valid())
+    return std::string();
+
+  static const char digits[] = "0123456789ABCDEF";
+  std::string result;
+  for (int shift = raw > 0xFF ? 12 : 4; shift >= 0; shift -= 4)
+    result += digits[(raw >> shift) & 0xF];
+  return result;
+}
+
+VcpValue VcpValue::parse(const std::string& text) {
+  size_t at = text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X') ? 2 : 0;
+  if (at == text.size() || text.size() - at > 4)
+    return VcpValue();
+
+  uint32_t result = 0;
+  for (; at < text.size(); ++at) {
+    const char c = text[at];
+    uint32_t digit;
+    if (c >= '0' && c <= '9')
+      digit = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      digit = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      digit = c - 'A' + 10;
+    else
+      return VcpValue();
+    result = result * 16 + digit;
+  }
+  return result != none ? VcpValue(uint16_t(result)) : VcpValue();
+}
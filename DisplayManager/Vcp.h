@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// MCCS feature codes known by name. Any other code still fits, e.g. one named by the active
+// control queue
+enum class VcpCode : uint8_t {
+  brightness = 0x10,
+  contrast = 0x12,
+  active_control = 0x52,
+  input_source = 0x60,
+};
+
+// The value of a non continuous control, e.g. an input source (0x0F is DisplayPort 1), kept as
+// the number the panel uses from the transport up to the models and storage. It only becomes
+// text (two hex digits, the way capabilities strings and older profiles write it) where people
+// or legacy settings see it.
+class VcpValue {
+  static const uint16_t none = 0xFFFF;
+  uint16_t raw;
+
+public:
+  constexpr VcpValue() : raw(none) {}
+  constexpr explicit VcpValue(uint16_t value) : raw(value) {}
+
+  // false for a value that was never read, or text that wasn't hex
+  bool valid() const { return raw != none; }
+  uint16_t value() const { return raw; }
+
+  bool operator==(VcpValue other) const { return raw == other.raw; }
+  bool operator!=(VcpValue other) const { return raw != other.raw; }
+  bool operator<(VcpValue other) const { return raw < other.raw; }
+
+  // "0F", empty if not valid
+  std::string toString() const;
+  // "0F", "0f" or "0x0F"
+  static VcpValue parse(const std::string& text);
+};
+
+namespace std {
+  template<>
+  struct hash<VcpValue> {
+    size_t operator()(VcpValue value) const { return value.value(); }
+  };
+}
@@ -1,10 +1,65 @@
 #include "DisplayManager.h"
+#include "ControlServer.h"
+#include "Log.h"
+#include "OneShot.h"
+#include "SharedState.h"
+#include "SwitchBenchmark.h"
+#include "Trace.h"
 #include <QtWidgets/QApplication>
 
 int main(int argc, char *argv[]) {
+  const auto start = std::chrono::steady_clock::now();
+  TraceSession trace;
+  LogSession log;
+  TRACE_THREAD("main");
+
   QCoreApplication::setOrganizationName("BlackledgeBuilds");
   QCoreApplication::setApplicationName("Display Manager");
 
+  // the headless modes never construct a widget
+  const QString mode = argc > 1 ? QString::fromLocal8Bit(argv[1]) : QString();
+  if (mode == "--daemon") {
+    QCoreApplication a(argc, argv);
+    ControlServer server;
+    if (!server.listen())
+      return 1;
+    return a.exec();
+  }
+  if (mode == "--ctl") {
+    QCoreApplication a(argc, argv);
+    return runControlClient(a.arguments().mid(2));
+  }
+  if (mode == "--state") {
+    QCoreApplication a(argc, argv);
+    return runPrintState();
+  }
+  if (mode == "--apply" && argc > 2) {
+    QCoreApplication a(argc, argv);
+    const auto args = a.arguments();
+    return runApply(args[2], args.contains("--timing"), start);
+  }
+  if (mode == "--bench-switch") {
+    QCoreApplication a(argc, argv);
+    return runSwitchBenchmark(a.arguments().mid(2));
+  }
+  if (mode == "--bench-hotkey") {
+    QCoreApplication a(argc, argv);
+    return runHotkeyBenchmark(a.arguments().mid(2));
+  }
+  if (mode == "--bench-dispatch") {
+    QCoreApplication a(argc, argv);
+    return runDispatchBenchmark(a.arguments().mid(2));
+  }
+  if (mode == "--bench-alloc") {
+    QCoreApplication a(argc, argv);
+    return runAllocationBenchmark(a.arguments().mid(2));
+  }
+  if (mode == "--bench-apply" && argc > 2) {
+    QCoreApplication a(argc, argv);
+    const auto args = a.arguments();
+    return runApplyBenchmark(args[2].toInt(), args.mid(3));
+  }
+
   QApplication a(argc, argv);
   DisplayManager w;
   w.show();
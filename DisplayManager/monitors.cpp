@@ -1,191 +1,143 @@
 #include "monitors.h"
+#include "DisplayBackend.h"
 #include "CapabilitiesParser.h"
-#include "wmi_helpers.h"
-
-#include <iostream>
-#include <sstream>
-#include <iomanip>
-#include <algorithm>
-#include <chrono>
-
-#include <QDebug>
-
-#define UNICODE 1
-#include <lowlevelmonitorconfigurationapi.h>
-#include <physicalmonitorenumerationapi.h>
-#include <windows.h>
-#include <vector>
-
-#pragma comment(lib, "Dxva2.lib")
-
-template<typename t, DISPLAYCONFIG_DEVICE_INFO_TYPE e>
-t getDeviceInfo(LUID adapterid, UINT32 id) {
-  t info_struct;
-  info_struct.header.type = e;
-  info_struct.header.size = sizeof(info_struct);
-  info_struct.header.adapterId = adapterid;
-  info_struct.header.id = id;
-  DisplayConfigGetDeviceInfo(&info_struct.header);
-  return info_struct;
-};
-
-std::wstring getSourceName(const DISPLAYCONFIG_PATH_INFO& path) {
-  return getDeviceInfo
-    <DISPLAYCONFIG_SOURCE_DEVICE_NAME, DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME>
-    (path.sourceInfo.adapterId,path.sourceInfo.id)
-    .viewGdiDeviceName;
-}
-
-std::wstring getTargetName(const DISPLAYCONFIG_PATH_INFO& path) {
-  return getDeviceInfo
-    <DISPLAYCONFIG_TARGET_DEVICE_NAME, DISPLAYCONFIG_DEVICE_INFO_GET_TARGET_NAME>
-    (path.targetInfo.adapterId, path.targetInfo.id)
-    .monitorFriendlyDeviceName;
-}
-
-struct ScopedPhysical {
-  const DWORD count;
-  PHYSICAL_MONITOR * const p;
-  
-
-  ScopedPhysical(const HMONITOR handle)
-  : count([&](){
-      DWORD c;
-      GetNumberOfPhysicalMonitorsFromHMONITOR(handle, &c);
-      return c;
-    }())
-  , p(count > 0 ? new PHYSICAL_MONITOR[count] : nullptr) 
-  {
-    if(p)
-      GetPhysicalMonitorsFromHMONITOR(handle, count, p);
-  }
-  ~ScopedPhysical() {
-    if(p) {
-      DestroyPhysicalMonitors(count, p);
-      delete p;
-    }
-  }
-  
-  PHYSICAL_MONITOR& operator[](int x) const {
-    return p[x];
-  }
-};
+#include "SimulatedBackend.h"
+#include "TransactionLog.h"
+#include "Log.h"
+#include "Trace.h"
+#ifdef _WIN32
+#include "Dxva2Backend.h"
+#elif defined(__linux__)
+#include "I2cBackend.h"
+#endif
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
 
 class DisplayObject::Data {
   static const char * input_names[];
 
 public:
-  //  these are all determinable from the initializing HMONITOR alone
+  std::unique_ptr<DisplayTransport> transport;
 
-  const HMONITOR handle;
-  const std::wstring sourceDeviceName;
-  const std::wstring id;
-  const std::wstring sub_id;
+  const std::wstring name;
+  const std::string serial;
+  const std::wstring hardware_id;
+  const DisplayLocation location;
+  const int track;
 
-  // determined by path matching
-  bool path_found = false;
-  std::wstring targetDeviceName;
+  // transports aren't required to be thread safe, serialize use of the bus
+  mutable std::mutex bus;
+  mutable std::atomic<std::chrono::steady_clock::rep> last_used{ 0 };
 
-  // determined by wmi matching
-  bool serial_found = false;
-  std::string serial;
+  void used() const {
+    last_used = std::chrono::steady_clock::now().time_since_epoch().count();
+  }
 
 
   ~Data() {}
-  Data(HMONITOR _handle) 
-  : handle(_handle)
-  , sourceDeviceName([&](){
-      MONITORINFOEXW info;
-      info.cbSize = sizeof(info);
-      GetMonitorInfoW(handle, &info);
-      return std::wstring(info.szDevice); }())
-  , id([&](){
-      DISPLAY_DEVICE display;
-      ZeroMemory(&display, sizeof(display));
-      display.cb = sizeof(display); 
-
-      if( !EnumDisplayDevices(sourceDeviceName.c_str(), 0, &display, 0) )
-        throw;
-      return std::wstring(display.DeviceID); }()) 
-  , sub_id([&](){
-      const int start = id.find(L'\\',0) + 1;
-      const int end = id.find(L'\\',start);
-      return id.substr(start, end - start); }())
+  Data(std::unique_ptr<DisplayTransport> _transport, const std::wstring& _name, const std::string& _serial, const std::wstring& _hardware_id, const DisplayLocation& _location)
+  : transport(std::move(_transport))
+  , name(_name)
+  , serial(_serial)
+  , hardware_id(_hardware_id)
+  , location(_location)
+  , track(TRACE_TRACK(_serial))
   {}
 
-  //getting capabilities is VERY expensive
-  sourceList getInputSources() const {
+  //getting capabilities is VERY expensive, so it is read fragment by fragment and only until
+  //the input sources have gone by. codes are listed in order, so active control (52) comes free
+  sourceList getInputSources(bool* active_control) const {
+    const int retries = 3;
     sourceList result;
-    const auto full_start = std::chrono::high_resolution_clock::now();
-    auto accum = full_start - full_start;
-
-    ScopedPhysical physicals(handle);
-    for (DWORD i = 0; i < physicals.count; i++) {
-      
-      auto physical = physicals[i].hPhysicalMonitor;
-      DWORD cchStringLength = 0;
-
-      const auto start = std::chrono::high_resolution_clock::now();
-
-      if (!GetCapabilitiesStringLength(physical, &cchStringLength))
-        continue;
-
-      const auto end = std::chrono::high_resolution_clock::now();
-      accum += (end - start);
-
-      // Allocate the string buffer.
-      LPSTR szCapabilitiesString = (LPSTR)malloc(cchStringLength);
-      // Get the capabilities string.
-
-      
-      CapabilitiesRequestAndCapabilitiesReply(physical, szCapabilitiesString, cchStringLength);
-      
-      
-
-      //parse features and add inputs
-      feature* top = parseFeatures(std::string(szCapabilitiesString)); //TODO avoid string
-      feature* modes = top->get(std::string("vcp"))->get(std::string("60"));
-      for(auto mode : modes->keys()) {
-        int index = std::stoi(mode, 0, 16);
-        if(index > 18) index = 0;
-        result.push_back(std::make_pair(input_names[index],mode));
+    if (active_control)
+      *active_control = false;
+
+    CapabilitiesStream stream({ "52", "60" });
+    {
+      TRACE_DISPLAY_SCOPE("capabilities", track);
+      uint16_t offset = 0;
+      int failures = 0;
+      std::string fragment;
+      while (!stream.done()) {
+        bool ok;
+        {
+          std::lock_guard<std::mutex> lock(bus);
+          used();
+          ok = transport->capabilitiesFragment(offset, fragment);
+        }
+        // a lost or corrupted reply is asked for again from the same offset
+        if (!ok) {
+          if (++failures > retries)
+            return result;
+          continue;
+        }
+        failures = 0;
+        if (fragment.empty())
+          break;
+        stream.feed(fragment);
+        offset += (uint16_t)fragment.size();
       }
-
-      delete top;
-      free(szCapabilitiesString);
     }
 
-    const auto full_end = std::chrono::high_resolution_clock::now();
-    //qDebug() << "Total: " << std::chrono::duration<double>(full_end - full_start).count();
-    //qDebug() << "Query: " << std::chrono::duration<double>(accum).count();
+    if (active_control)
+      *active_control = stream.listed("52");
+    for (auto& mode : stream.values("60")) {
+      const auto value = VcpValue::parse(mode);
+      if (!value.valid())
+        continue;
+      result.push_back(std::make_pair(input_names[value.value() <= 18 ? value.value() : 0], value));
+    }
     return result;
   }
 
 
-  std::vector<DWORD> getVCP(BYTE code) const {
-    std::vector<DWORD> result;
-    ScopedPhysical physicals(handle);
-    for (DWORD i = 0; i < physicals.count; i++) {
-      auto physical = physicals[i].hPhysicalMonitor;
-      DWORD current = 0, max = 0;
-      std::cout << physical << (GetVCPFeatureAndVCPFeatureReply(physical, code, NULL, &current, &max) ? " vcp get" : " vcp fail") << std::endl;
-      if (code == 0x60)
-        current = current % 256;
-      result.push_back(current);
-    }
-    return result;
+  bool getVCP(uint8_t code, uint32_t& current, uint32_t& max) const {
+    TRACE_DISPLAY_SCOPE("getVCP", track);
+    std::lock_guard<std::mutex> lock(bus);
+    used();
+    return unpack(code, transport->getVCP(code), current, max);
+  }
+  static bool unpack(uint8_t code, const DisplayTransport::Reply& reply, uint32_t& current, uint32_t& max) {
+    if (!reply.ok)
+      return false;
+
+    current = reply.current;
+    max = reply.max;
+    // the input select high byte is vendor specific
+    if (code == uint8_t(VcpCode::input_source))
+      current = current % 256;
+    return true;
   }
-  bool setVCP(BYTE code, DWORD value) const {
-    bool result;
-    ScopedPhysical physicals(handle);
-    for (DWORD i = 0; i < physicals.count; i++) {
-      auto physical = physicals[i].hPhysicalMonitor;
-      result &= (bool)SetVCPFeature(physical, code, value);
+
+  // holds the bus from begin to finish, released even if the transport throws
+  template<typename Call>
+  auto begin(Call call) const -> decltype(call()) {
+    bus.lock();
+    used();
+    try {
+      return call();
     }
-    return result;
+    catch (...) {
+      bus.unlock();
+      throw;
+    }
+  }
+  template<typename Call>
+  auto finish(Call call) const -> decltype(call()) {
+    std::unique_lock<std::mutex> lock(bus, std::adopt_lock);
+    used();
+    return call();
+  }
+  bool setVCP(uint8_t code, uint32_t value) const {
+    TRACE_DISPLAY_SCOPE("setVCP", track);
+    std::lock_guard<std::mutex> lock(bus);
+    used();
+    return transport->setVCP(code, value);
   }
   void debugDisplay() const {
-    std::wcout << sourceDeviceName.c_str() << " - " << targetDeviceName.c_str() << std::endl;
+    LOG_INFO("{} - {}", name, hardware_id);
   }
 };
 
@@ -218,8 +170,8 @@ const char * DisplayObject::Data::input_names[] = {
 
 
 DisplayObject::~DisplayObject() {}
-DisplayObject::DisplayObject(void* hMonitor)
-  : data(std::make_unique<Data>((HMONITOR)hMonitor))
+DisplayObject::DisplayObject(std::unique_ptr<DisplayTransport> transport, const std::wstring& name, const std::string& serial, const std::wstring& hardware_id, const DisplayLocation& location)
+  : data(std::make_unique<Data>(std::move(transport), name, serial, hardware_id, location))
 {}
 void DisplayObject::debugDisplay() const {
   d().debugDisplay();
@@ -232,132 +184,166 @@ DisplayObject& DisplayObject::operator=(DisplayObject&& other) noexcept {
   return *this;
 }
 const std::wstring& DisplayObject::name() const {
-  return d().targetDeviceName;
+  return d().name;
 }
 
-DisplayObject::sourceList DisplayObject::sources() const {
-  return d().getInputSources();
+DisplayObject::sourceList DisplayObject::sources(bool* active_control) const {
+  return d().getInputSources(active_control);
 }
 
-std::string DisplayObject::current() const {
-  std::stringstream result;
-  auto sources = d().getVCP(0x60);
+VcpValue DisplayObject::current() const {
+  uint32_t current, max;
+  if (!d().getVCP(uint8_t(VcpCode::input_source), current, max))
+    return VcpValue();
+  return VcpValue(uint16_t(current));
+}
 
-  if(!sources.empty())
-    result << std::setw(2) << std::setfill('0') << std::uppercase << std::hex << sources.at(0);
+void DisplayObject::setInput(VcpValue input) const {
+  if (!input.valid() || current() == input)
+    return;
+  d().setVCP(uint8_t(VcpCode::input_source), input.value());
+}
 
-  return result.str();
+bool DisplayObject::readRange(VcpCode code, uint32_t& current, uint32_t& max) const {
+  return d().getVCP(uint8_t(code), current, max);
 }
 
-void DisplayObject::setInput(const std::string& s) const {
-  if(current() == s)
-    return;
-    
-  int num = std::stoi(s, 0, 16);
-  d().setVCP(0x60, num);
+bool DisplayObject::write(VcpCode code, uint32_t value) const {
+  return d().setVCP(uint8_t(code), value);
 }
 
-const std::string& DisplayObject::serial() const {
-  return d().serial;
+std::chrono::microseconds DisplayObject::busyFor() const {
+  return d().transport->busyFor();
 }
 
+std::chrono::microseconds DisplayObject::beginRead(VcpCode code) const {
+  return d().begin([&]() { return d().transport->beginGetVCP(uint8_t(code)); });
+}
 
-// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
-//     DisplayManager
-// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+bool DisplayObject::finishRead(VcpCode code, uint32_t& current, uint32_t& max) const {
+  return Data::unpack(uint8_t(code), d().finish([&]() { return d().transport->finishGetVCP(uint8_t(code)); }), current, max);
+}
 
+std::chrono::microseconds DisplayObject::beginWrite(VcpCode code, uint32_t value) const {
+  return d().begin([&]() { return d().transport->beginSetVCP(uint8_t(code), value); });
+}
 
-BOOL CALLBACK MonitorEnumProc(HMONITOR hMonitor, HDC hdcMonitor, LPRECT lprcMonitor, LPARAM dwData)
-{
-  devices* result = reinterpret_cast<devices*>(dwData);
-  result->push_back(std::move(DisplayObject(hMonitor)));
-  return TRUE;
+bool DisplayObject::finishWrite(VcpCode code, uint32_t value) const {
+  return d().finish([&]() { return d().transport->finishSetVCP(uint8_t(code), value); });
 }
 
-void determinePaths(devices& data) {
-  UINT32 requiredPaths, requiredModes;
-  GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &requiredPaths, &requiredModes);
-  std::vector<DISPLAYCONFIG_PATH_INFO> paths(requiredPaths);
-  std::vector<DISPLAYCONFIG_MODE_INFO> modes(requiredModes);
-  QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &requiredPaths, paths.data(), &requiredModes, modes.data(), nullptr);
-  for (auto& p : paths) {
-    const auto sourceName = getSourceName(p);
-    bool unique = true;
-    
-    for(auto& d : data) {
-      if( d.d().sourceDeviceName == sourceName ) {
-        if( d.d().path_found || !unique )
-          throw;
-        unique = false;
-        d.d().path_found = true;
-        d.d().targetDeviceName = getTargetName(p);
-      }
-    }
-    if( unique )
-      throw;
-  }
+const std::string& DisplayObject::serial() const {
+  return d().serial;
+}
 
-  for(auto& d : data) {
-    if( !d.d().path_found )
-      throw;
-  }
+const std::wstring& DisplayObject::hardwareId() const {
+  return d().hardware_id;
 }
 
-void determineWMI(devices& data) {
-  HRESULT hres;
+const DisplayLocation& DisplayObject::location() const {
+  return d().location;
+}
 
-  try {
-    ServiceWrapper helper(L"\\\\.\\root\\wmi", hres);
+int DisplayObject::traceTrack() const {
+  return d().track;
+}
 
-    auto query = helper.query(L"WQL",L"SELECT * FROM WmiMonitorID", hres);
+std::chrono::steady_clock::time_point DisplayObject::lastUsed() const {
+  return std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(d().last_used.load()));
+}
 
-    if (FAILED(hres)) throw WMIH_Exception("Query failed.");
+void DisplayObject::wrapTransport(const transportWrapper& wrap) {
+  d().transport = wrap(std::move(d().transport));
+}
 
-    ObjectWrapper obj;
-    int i = 0;
-    std::cout << "Instance ID - Serial ID - Device Name" << std::endl;
-    while (obj = query.Next()) {
 
-      const auto id = obj.getBSTR(L"InstanceName");
-      const auto serial = obj.getCharArray(L"SerialNumberID", 14);
-      if( id.empty() || serial.empty() )
-        throw;
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     DisplayBackend
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
 
-      const int start = id.find(L'\\',0) + 1;
-      const int end = id.find(L'\\',start);
-      const auto sub_id = id.substr(start, end - start);
 
-      bool unique = true;
-    
-      for(auto& d : data) {
-        if( d.d().sub_id == sub_id ) {
-          if( d.d().serial_found || !unique )
-            throw;
-          unique = false;
-          d.d().serial_found = true;
-          d.d().serial = serial;
-        }
-      }
-    }
-  }
-  catch (WMIH_Exception& e) {
-    std::cout << e.what() << " Error code = 0x" << std::hex << hres << std::endl;
-    std::cout << _com_error(hres).ErrorMessage() << std::endl;
+std::shared_ptr<DisplayBackend> DisplayBackend::create() {
+  const char* replay = std::getenv("DISPLAYMANAGER_REPLAY");
+  if (replay) {
+    const char* speed = std::getenv("DISPLAYMANAGER_REPLAY_SPEED");
+    return std::make_shared<ReplayBackend>(replay, speed ? std::atof(speed) : 1.0);
   }
 
-  for(auto& d : data) {
-    if( !d.d().serial_found )
-      throw;
-  }
+  std::shared_ptr<DisplayBackend> result;
+  const char* simulate = std::getenv("DISPLAYMANAGER_SIMULATOR");
+#ifdef _WIN32
+  if (!simulate)
+    result = std::make_shared<Dxva2Backend>();
+#elif defined(__linux__)
+  if (!simulate)
+    result = std::make_shared<I2cBackend>();
+#endif
+  if (!result)
+    result = std::make_shared<SimulatedBackend>(SimulatorConfig::parse(simulate ? simulate : ""));
+
+  const char* record = std::getenv("DISPLAYMANAGER_RECORD");
+  if (record)
+    result = std::make_shared<RecordingBackend>(std::move(result), record);
+  return result;
 }
 
+
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+//     DisplayCollection
+// ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
+
+
+DisplayCollection::~DisplayCollection() {}
+
+DisplayCollection::DisplayCollection()
+: backend(DisplayBackend::create())
+{}
+
+DisplayCollection::DisplayCollection(std::shared_ptr<DisplayBackend> _backend)
+: backend(_backend ? std::move(_backend) : DisplayBackend::create())
+{}
+
 const devices& DisplayCollection::get() const {
   return data;
 }
 
 void DisplayCollection::refresh() {
+  TRACE_SCOPE("DisplayCollection::refresh");
+  data.clear();
+  index.clear();
+  backend->enumerate(data);
+  index.rebuild(data, groups);
+}
+
+bool DisplayCollection::refreshCached(const identityMap& known, const std::vector<std::string>& wanted) {
+  TRACE_SCOPE("DisplayCollection::refreshCached");
   data.clear();
-  EnumDisplayMonitors(NULL, NULL, &MonitorEnumProc, reinterpret_cast<LPARAM>(&data));
-  determinePaths(data);
-  determineWMI(data);
-}
\ No newline at end of file
+  index.clear();
+  if (known.empty())
+    return false;
+
+  const bool complete = backend->enumerateCached(data, known, wanted);
+  index.rebuild(data, groups);
+  return complete;
+}
+
+identityMap DisplayCollection::identities() const {
+  identityMap result;
+  for (auto& d : data)
+    result.emplace(d.d().hardware_id, d.d().serial);
+  return result;
+}
+
+const DisplayRegistry& DisplayCollection::registry() const {
+  return index;
+}
+
+const DisplayObject* DisplayCollection::find(const std::string& serial) const {
+  const int position = index.bySerial(serial);
+  return position >= 0 ? &data[position] : nullptr;
+}
+
+void DisplayCollection::setGroups(std::unordered_map<std::string, std::string> _groups) {
+  groups = std::move(_groups);
+  index.rebuild(data, groups);
+}
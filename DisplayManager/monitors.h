@@ -1,15 +1,34 @@
 #pragma once
 
 #include "common.h"
+#include "DisplayRegistry.h"
+#include "Vcp.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+class DisplayTransport;
+class DisplayBackend;
+
+// where a display hangs off the system, as far as the backend can tell
+struct DisplayLocation {
+  // stable name of the output and panel, e.g. "\\.\DISPLAY1/0"
+  std::wstring connector;
+  // displays with the same bus share one DDC channel, -1 if unknown
+  int bus = -1;
+};
+
 struct DisplayObject {
   PIMPL
-  
-  using sourceList = std::vector<std::pair<std::string, std::string>>;
+
+  // input name -> value, as listed in the capabilities
+  using sourceList = std::vector<std::pair<std::string, VcpValue>>;
 
   ~DisplayObject();
-  DisplayObject(void*);
+  DisplayObject(std::unique_ptr<DisplayTransport>, const std::wstring& name, const std::string& serial, const std::wstring& hardware_id, const DisplayLocation& = DisplayLocation());
 
   DisplayObject(const DisplayObject&) = delete;
   DisplayObject& operator=(const DisplayObject&) = delete;
@@ -19,19 +38,63 @@ struct DisplayObject {
   //monitor API stuff
   void debugDisplay() const;
   const std::wstring& name() const;
-  sourceList sources() const;
-  std::string current() const;
-  void setInput(const std::string&) const;
+  // active_control, if given, is set to whether the capabilities list VCP 0x52
+  sourceList sources(bool* active_control = nullptr) const;
+  // not valid if the panel didn't answer
+  VcpValue current() const;
+  void setInput(VcpValue) const;
+
+  //continuous controls like brightness, false if no panel answered
+  bool readRange(VcpCode code, uint32_t& current, uint32_t& max) const;
+  bool write(VcpCode code, uint32_t value) const;
+
+  // split phase access for DdcEngine, see DisplayTransport. the display's bus stays locked from
+  // begin to finish, which must be called on the same thread
+  std::chrono::microseconds busyFor() const;
+  std::chrono::microseconds beginRead(VcpCode code) const;
+  bool finishRead(VcpCode code, uint32_t& current, uint32_t& max) const;
+  std::chrono::microseconds beginWrite(VcpCode code, uint32_t value) const;
+  bool finishWrite(VcpCode code, uint32_t value) const;
 
   //WQL stuff
   const std::string& serial() const;
+  const std::wstring& hardwareId() const;
+  const DisplayLocation& location() const;
+  int traceTrack() const;
+  // when this display last had any DDC traffic
+  std::chrono::steady_clock::time_point lastUsed() const;
+
+  // layers another transport over this display's own, e.g. to record its traffic.
+  // only safe before the display is shared with other threads
+  using transportWrapper = std::function<std::unique_ptr<DisplayTransport>(std::unique_ptr<DisplayTransport>)>;
+  void wrapTransport(const transportWrapper&);
 };
 
-using devices = std::vector<DisplayObject>;
+// hardware id (as found in the display device path) -> serial, as resolved by wmi
+using identityMap = std::unordered_map<std::wstring, std::string>;
 
 class DisplayCollection {
+  std::shared_ptr<DisplayBackend> backend;
   devices data;
+  DisplayRegistry index;
+  std::unordered_map<std::string, std::string> groups;
 public:
+  ~DisplayCollection();
+  DisplayCollection();
+  // a null backend picks the default, see DisplayBackend::create
+  explicit DisplayCollection(std::shared_ptr<DisplayBackend>);
+
   const devices& get() const;
   void refresh();
+
+  // skips path and wmi matching, taking serials from a previous refresh instead, and stops
+  // enumerating once every wanted serial is found. returns false if an unknown display was
+  // encountered before that, in which case a full refresh is needed
+  bool refreshCached(const identityMap& known, const std::vector<std::string>& wanted);
+  identityMap identities() const;
+
+  const DisplayRegistry& registry() const;
+  const DisplayObject* find(const std::string& serial) const;
+  // serial -> group, kept across refreshes
+  void setGroups(std::unordered_map<std::string, std::string>);
 };
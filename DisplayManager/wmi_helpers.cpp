@@ -1,4 +1,5 @@
 #include "wmi_helpers.h"
+#include "Log.h"
 
 
 // ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~
@@ -96,50 +97,18 @@ ObjectWrapper ObjectWrapper::getRef(LPCWSTR property, ServiceWrapper& sw) {
 }
 
 void ObjectWrapper::scanWMIMonitorID(){
-  bool any_show = false;
   const auto instanceName = getBSTR(L"InstanceName");
-  if( !instanceName.empty() ) {
-    any_show = true;
-    std::wcout << instanceName.c_str();
-  }
-
   const auto serialNumberID = getCharArray(L"SerialNumberID", 14);
-  if( !serialNumberID.empty() ) {
-    if( any_show )
-      std::wcout << " - ";
-    any_show = true;
-    std::wcout << serialNumberID.c_str();
-  }
-
   const auto userFriendlyName = getSizedCharArray(L"UserFriendlyName", L"UserFriendlyNameLength");
-  if( !userFriendlyName.empty() ){
-    if( any_show )
-      std::wcout << " - ";
-    any_show = true;
-    std::wcout << userFriendlyName.c_str();
-  }
-  if (any_show)
-    std::wcout << std::endl;
+  if( !instanceName.empty() || !serialNumberID.empty() || !userFriendlyName.empty() )
+    LOG_INFO("{} - {} - {}", instanceName, serialNumberID, userFriendlyName);
 }
 
 void ObjectWrapper::scanUSBHubName(){
-  bool any_show = false;
   const auto deviceID = getBSTR(L"DeviceID");
-  if( !deviceID.empty() ) {
-    any_show = true;
-    std::wcout << deviceID.c_str();
-  }
-
   const auto deviceDesc = getBSTR(L"Description");
-  if( !deviceDesc.empty() ) {
-    if( any_show )
-      std::wcout << " - ";
-    any_show = true;
-    std::wcout << deviceDesc.c_str();
-  }
-
-  if (any_show)
-    std::wcout << std::endl;
+  if( !deviceID.empty() || !deviceDesc.empty() )
+    LOG_INFO("{} - {}", deviceID, deviceDesc);
 }
 
 // ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~    ~~~~